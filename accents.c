@@ -27,19 +27,26 @@
 
 #include <ctype.h>
 #include <string.h>
-#include <stdbool.h>
 #include <sys/types.h>
 #include <stddef.h>
 #include <stdio.h>
-#include <recode.h>
 
 #include "bibtex.h"
 
-typedef struct  {
-    gchar c;
-    gchar m;
+/* 
+   Everything is converted straight into UTF-8. An accent command
+   has, for each ASCII letter, the precomposed character if there is
+   one; otherwise its combining character follows the letter.
+*/
+typedef struct {
+    const gchar * const * table;
+
+    const gchar * combining;
+
+    /* the accent on its own, when there is nothing to put it on */
+    const gchar * alone;
 }
-CharMapping;
+Accent;
 
 typedef struct  {
     gchar * c;
@@ -47,321 +54,572 @@ typedef struct  {
 }
 StringMapping;
 
-CharMapping acute [] = {
-    {'A', '\xC1'},
-    {'E', '\xC9'},
-    {'I', '\xCD'},
-    {'O', '\xD3'},
-    {'U', '\xDA'},
-    {'Y', '\xDD'},
-    {'a', '\xE1'},
-    {'e', '\xE9'},
-    {'i', '\xED'},
-    {'o', '\xF3'},
-    {'u', '\xFA'},
-    {'y', '\xFD'},
-    {0, 0}
+/* \', acute */
+static const gchar * const acute [128] = {
+    ['A'] = "\xC3\x81", ['C'] = "\xC4\x86", ['E'] = "\xC3\x89",
+    ['G'] = "\xC7\xB4", ['I'] = "\xC3\x8D", ['K'] = "\xE1\xB8\xB0",
+    ['L'] = "\xC4\xB9", ['M'] = "\xE1\xB8\xBE", ['N'] = "\xC5\x83",
+    ['O'] = "\xC3\x93", ['P'] = "\xE1\xB9\x94", ['R'] = "\xC5\x94",
+    ['S'] = "\xC5\x9A", ['U'] = "\xC3\x9A", ['W'] = "\xE1\xBA\x82",
+    ['Y'] = "\xC3\x9D", ['Z'] = "\xC5\xB9", ['a'] = "\xC3\xA1",
+    ['c'] = "\xC4\x87", ['e'] = "\xC3\xA9", ['g'] = "\xC7\xB5",
+    ['i'] = "\xC3\xAD", ['k'] = "\xE1\xB8\xB1", ['l'] = "\xC4\xBA",
+    ['m'] = "\xE1\xB8\xBF", ['n'] = "\xC5\x84", ['o'] = "\xC3\xB3",
+    ['p'] = "\xE1\xB9\x95", ['r'] = "\xC5\x95", ['s'] = "\xC5\x9B",
+    ['u'] = "\xC3\xBA", ['w'] = "\xE1\xBA\x83", ['y'] = "\xC3\xBD",
+    ['z'] = "\xC5\xBA",
 };
 
-CharMapping grave [] = {
-    {'A', '\xC0'},
-    {'E', '\xC8'},
-    {'I', '\xCC'},
-    {'O', '\xD2'},
-    {'U', '\xD9'},
-    {'a', '\xE0'},
-    {'e', '\xE8'},
-    {'i', '\xEC'},
-    {'o', '\xF2'},
-    {'u', '\xF9'},
-    {0, 0}
+/* \`, grave */
+static const gchar * const grave [128] = {
+    ['A'] = "\xC3\x80", ['E'] = "\xC3\x88", ['I'] = "\xC3\x8C",
+    ['N'] = "\xC7\xB8", ['O'] = "\xC3\x92", ['U'] = "\xC3\x99",
+    ['W'] = "\xE1\xBA\x80", ['Y'] = "\xE1\xBB\xB2", ['a'] = "\xC3\xA0",
+    ['e'] = "\xC3\xA8", ['i'] = "\xC3\xAC", ['n'] = "\xC7\xB9",
+    ['o'] = "\xC3\xB2", ['u'] = "\xC3\xB9", ['w'] = "\xE1\xBA\x81",
+    ['y'] = "\xE1\xBB\xB3",
 };
 
-CharMapping hat [] = {
-    {'A', '\xC2'},
-    {'E', '\xCA'},
-    {'I', '\xCE'},
-    {'O', '\xD4'},
-    {'U', '\xDB'},
-    {'a', '\xE2'},
-    {'e', '\xEA'},
-    {'i', '\xEE'},
-    {'o', '\xF4'},
-    {'u', '\xFB'},
-    {0, 0}
+/* \^, circumflex */
+static const gchar * const circumflex [128] = {
+    ['A'] = "\xC3\x82", ['C'] = "\xC4\x88", ['E'] = "\xC3\x8A",
+    ['G'] = "\xC4\x9C", ['H'] = "\xC4\xA4", ['I'] = "\xC3\x8E",
+    ['J'] = "\xC4\xB4", ['O'] = "\xC3\x94", ['S'] = "\xC5\x9C",
+    ['U'] = "\xC3\x9B", ['W'] = "\xC5\xB4", ['Y'] = "\xC5\xB6",
+    ['Z'] = "\xE1\xBA\x90", ['a'] = "\xC3\xA2", ['c'] = "\xC4\x89",
+    ['e'] = "\xC3\xAA", ['g'] = "\xC4\x9D", ['h'] = "\xC4\xA5",
+    ['i'] = "\xC3\xAE", ['j'] = "\xC4\xB5", ['o'] = "\xC3\xB4",
+    ['s'] = "\xC5\x9D", ['u'] = "\xC3\xBB", ['w'] = "\xC5\xB5",
+    ['y'] = "\xC5\xB7", ['z'] = "\xE1\xBA\x91",
 };
 
-CharMapping trema [] = {
-    {'A', '\xC4'},
-    {'E', '\xCB'},
-    {'I', '\xCF'},
-    {'O', '\xD6'},
-    {'U', '\xDC'},
-    {'a', '\xE4'},
-    {'e', '\xEB'},
-    {'i', '\xEF'},
-    {'o', '\xF6'},
-    {'u', '\xFC'},
-    {'y', '\xFF'},
-    {0, 0}
+/* \", diaeresis */
+static const gchar * const diaeresis [128] = {
+    ['A'] = "\xC3\x84", ['E'] = "\xC3\x8B", ['H'] = "\xE1\xB8\xA6",
+    ['I'] = "\xC3\x8F", ['O'] = "\xC3\x96", ['U'] = "\xC3\x9C",
+    ['W'] = "\xE1\xBA\x84", ['X'] = "\xE1\xBA\x8C", ['Y'] = "\xC5\xB8",
+    ['a'] = "\xC3\xA4", ['e'] = "\xC3\xAB", ['h'] = "\xE1\xB8\xA7",
+    ['i'] = "\xC3\xAF", ['o'] = "\xC3\xB6", ['t'] = "\xE1\xBA\x97",
+    ['u'] = "\xC3\xBC", ['w'] = "\xE1\xBA\x85", ['x'] = "\xE1\xBA\x8D",
+    ['y'] = "\xC3\xBF",
 };
 
-CharMapping cedilla [] = {
-    {'C', '\xC7'},
-    {'c', '\xE7'},
-    {0, 0}
+/* \~, tilde */
+static const gchar * const tilde [128] = {
+    ['A'] = "\xC3\x83", ['E'] = "\xE1\xBA\xBC", ['I'] = "\xC4\xA8",
+    ['N'] = "\xC3\x91", ['O'] = "\xC3\x95", ['U'] = "\xC5\xA8",
+    ['V'] = "\xE1\xB9\xBC", ['Y'] = "\xE1\xBB\xB8", ['a'] = "\xC3\xA3",
+    ['e'] = "\xE1\xBA\xBD", ['i'] = "\xC4\xA9", ['n'] = "\xC3\xB1",
+    ['o'] = "\xC3\xB5", ['u'] = "\xC5\xA9", ['v'] = "\xE1\xB9\xBD",
+    ['y'] = "\xE1\xBB\xB9",
 };
 
-CharMapping tilda [] = {
-    {'A', '\xC3'},
-    {'O', '\xD5'},
-    {'a', '\xE3'},
-    {'o', '\xF5'},
-    {'n', '\xF1'},
-    {'N', '\xD1'},
-    {0, 0}
+/* \=, macron */
+static const gchar * const macron [128] = {
+    ['A'] = "\xC4\x80", ['E'] = "\xC4\x92", ['G'] = "\xE1\xB8\xA0",
+    ['I'] = "\xC4\xAA", ['O'] = "\xC5\x8C", ['U'] = "\xC5\xAA",
+    ['Y'] = "\xC8\xB2", ['a'] = "\xC4\x81", ['e'] = "\xC4\x93",
+    ['g'] = "\xE1\xB8\xA1", ['i'] = "\xC4\xAB", ['o'] = "\xC5\x8D",
+    ['u'] = "\xC5\xAB", ['y'] = "\xC8\xB3",
 };
 
-StringMapping commands [] = {
-    {"backslash", "\\"},
-    {"S",  "\xA7"},
-    {"ss", "\xDF"},
-    {"DH", "\xD0"},
-    {"dh", "\xF0"},
-    {"AE", "\xC6"},
-    {"ae", "\xE6"},
-    {"O",  "\xD8"},
-    {"o",  "\xF8"},
-    {"TH", "\xDE"},
-    {"th", "\xFE"},
-    {"aa", "\xE5"},
-    {"AA", "\xC5"},
-    {"guillemotleft",    "\xAB"},
-    {"guillemotright",   "\xBB"},
-    {"flqq",             "\xAB"},
-    {"frqq",             "\xBB"},
-    {"guilsingleft",     "<"},
-    {"guilsingright",    ">"},
-    {"textquestiondown", "\xBF"},
-    {"textexclamdown",   "\xA1"},
-    {"copyright",        "\xA9"},
-    {"pound",            "\xA3"},
-    {"neg",              "\xAC"},
-    {"-",                "\xAD"},
-    {"cdotp",            "\xB7"},
-    {",",                "\xB8"},
-    {NULL, NULL}
+/* \., dot above */
+static const gchar * const dot [128] = {
+    ['A'] = "\xC8\xA6", ['B'] = "\xE1\xB8\x82", ['C'] = "\xC4\x8A",
+    ['D'] = "\xE1\xB8\x8A", ['E'] = "\xC4\x96", ['F'] = "\xE1\xB8\x9E",
+    ['G'] = "\xC4\xA0", ['H'] = "\xE1\xB8\xA2", ['I'] = "\xC4\xB0",
+    ['M'] = "\xE1\xB9\x80", ['N'] = "\xE1\xB9\x84", ['O'] = "\xC8\xAE",
+    ['P'] = "\xE1\xB9\x96", ['R'] = "\xE1\xB9\x98", ['S'] = "\xE1\xB9\xA0",
+    ['T'] = "\xE1\xB9\xAA", ['W'] = "\xE1\xBA\x86", ['X'] = "\xE1\xBA\x8A",
+    ['Y'] = "\xE1\xBA\x8E", ['Z'] = "\xC5\xBB", ['a'] = "\xC8\xA7",
+    ['b'] = "\xE1\xB8\x83", ['c'] = "\xC4\x8B", ['d'] = "\xE1\xB8\x8B",
+    ['e'] = "\xC4\x97", ['f'] = "\xE1\xB8\x9F", ['g'] = "\xC4\xA1",
+    ['h'] = "\xE1\xB8\xA3", ['m'] = "\xE1\xB9\x81", ['n'] = "\xE1\xB9\x85",
+    ['o'] = "\xC8\xAF", ['p'] = "\xE1\xB9\x97", ['r'] = "\xE1\xB9\x99",
+    ['s'] = "\xE1\xB9\xA1", ['t'] = "\xE1\xB9\xAB", ['w'] = "\xE1\xBA\x87",
+    ['x'] = "\xE1\xBA\x8B", ['y'] = "\xE1\xBA\x8F", ['z'] = "\xC5\xBC",
+};
+
+/* \u, breve */
+static const gchar * const breve [128] = {
+    ['A'] = "\xC4\x82", ['E'] = "\xC4\x94", ['G'] = "\xC4\x9E",
+    ['I'] = "\xC4\xAC", ['O'] = "\xC5\x8E", ['U'] = "\xC5\xAC",
+    ['a'] = "\xC4\x83", ['e'] = "\xC4\x95", ['g'] = "\xC4\x9F",
+    ['i'] = "\xC4\xAD", ['o'] = "\xC5\x8F", ['u'] = "\xC5\xAD",
 };
 
-static gchar *
-initialize_table (CharMapping * map, char empty) {
-    gchar * table;
+/* \v, caron */
+static const gchar * const caron [128] = {
+    ['A'] = "\xC7\x8D", ['C'] = "\xC4\x8C", ['D'] = "\xC4\x8E",
+    ['E'] = "\xC4\x9A", ['G'] = "\xC7\xA6", ['H'] = "\xC8\x9E",
+    ['I'] = "\xC7\x8F", ['K'] = "\xC7\xA8", ['L'] = "\xC4\xBD",
+    ['N'] = "\xC5\x87", ['O'] = "\xC7\x91", ['R'] = "\xC5\x98",
+    ['S'] = "\xC5\xA0", ['T'] = "\xC5\xA4", ['U'] = "\xC7\x93",
+    ['Z'] = "\xC5\xBD", ['a'] = "\xC7\x8E", ['c'] = "\xC4\x8D",
+    ['d'] = "\xC4\x8F", ['e'] = "\xC4\x9B", ['g'] = "\xC7\xA7",
+    ['h'] = "\xC8\x9F", ['i'] = "\xC7\x90", ['j'] = "\xC7\xB0",
+    ['k'] = "\xC7\xA9", ['l'] = "\xC4\xBE", ['n'] = "\xC5\x88",
+    ['o'] = "\xC7\x92", ['r'] = "\xC5\x99", ['s'] = "\xC5\xA1",
+    ['t'] = "\xC5\xA5", ['u'] = "\xC7\x94", ['z'] = "\xC5\xBE",
+};
 
-    g_return_val_if_fail (map != NULL, NULL);
+/* \H, double acute */
+static const gchar * const hungarumlaut [128] = {
+    ['O'] = "\xC5\x90", ['U'] = "\xC5\xB0", ['o'] = "\xC5\x91",
+    ['u'] = "\xC5\xB1",
+};
 
-    table = g_new0 (gchar, 256);
+/* \r, ring above */
+static const gchar * const ring [128] = {
+    ['A'] = "\xC3\x85", ['U'] = "\xC5\xAE", ['a'] = "\xC3\xA5",
+    ['u'] = "\xC5\xAF", ['w'] = "\xE1\xBA\x98", ['y'] = "\xE1\xBA\x99",
+};
 
-    while (map->c != '\0') {
-	table [(int) map->c] = map->m;
-	map ++;
-    }
+/* \c, cedilla */
+static const gchar * const cedilla [128] = {
+    ['C'] = "\xC3\x87", ['D'] = "\xE1\xB8\x90", ['E'] = "\xC8\xA8",
+    ['G'] = "\xC4\xA2", ['H'] = "\xE1\xB8\xA8", ['K'] = "\xC4\xB6",
+    ['L'] = "\xC4\xBB", ['N'] = "\xC5\x85", ['R'] = "\xC5\x96",
+    ['S'] = "\xC5\x9E", ['T'] = "\xC5\xA2", ['c'] = "\xC3\xA7",
+    ['d'] = "\xE1\xB8\x91", ['e'] = "\xC8\xA9", ['g'] = "\xC4\xA3",
+    ['h'] = "\xE1\xB8\xA9", ['k'] = "\xC4\xB7", ['l'] = "\xC4\xBC",
+    ['n'] = "\xC5\x86", ['r'] = "\xC5\x97", ['s'] = "\xC5\x9F",
+    ['t'] = "\xC5\xA3",
+};
 
-    table [0] = empty;
+/* \k, ogonek */
+static const gchar * const ogonek [128] = {
+    ['A'] = "\xC4\x84", ['E'] = "\xC4\x98", ['I'] = "\xC4\xAE",
+    ['O'] = "\xC7\xAA", ['U'] = "\xC5\xB2", ['a'] = "\xC4\x85",
+    ['e'] = "\xC4\x99", ['i'] = "\xC4\xAF", ['o'] = "\xC7\xAB",
+    ['u'] = "\xC5\xB3",
+};
+
+/* \d, dot below */
+static const gchar * const dotbelow [128] = {
+    ['A'] = "\xE1\xBA\xA0", ['B'] = "\xE1\xB8\x84", ['D'] = "\xE1\xB8\x8C",
+    ['E'] = "\xE1\xBA\xB8", ['H'] = "\xE1\xB8\xA4", ['I'] = "\xE1\xBB\x8A",
+    ['K'] = "\xE1\xB8\xB2", ['L'] = "\xE1\xB8\xB6", ['M'] = "\xE1\xB9\x82",
+    ['N'] = "\xE1\xB9\x86", ['O'] = "\xE1\xBB\x8C", ['R'] = "\xE1\xB9\x9A",
+    ['S'] = "\xE1\xB9\xA2", ['T'] = "\xE1\xB9\xAC", ['U'] = "\xE1\xBB\xA4",
+    ['V'] = "\xE1\xB9\xBE", ['W'] = "\xE1\xBA\x88", ['Y'] = "\xE1\xBB\xB4",
+    ['Z'] = "\xE1\xBA\x92", ['a'] = "\xE1\xBA\xA1", ['b'] = "\xE1\xB8\x85",
+    ['d'] = "\xE1\xB8\x8D", ['e'] = "\xE1\xBA\xB9", ['h'] = "\xE1\xB8\xA5",
+    ['i'] = "\xE1\xBB\x8B", ['k'] = "\xE1\xB8\xB3", ['l'] = "\xE1\xB8\xB7",
+    ['m'] = "\xE1\xB9\x83", ['n'] = "\xE1\xB9\x87", ['o'] = "\xE1\xBB\x8D",
+    ['r'] = "\xE1\xB9\x9B", ['s'] = "\xE1\xB9\xA3", ['t'] = "\xE1\xB9\xAD",
+    ['u'] = "\xE1\xBB\xA5", ['v'] = "\xE1\xB9\xBF", ['w'] = "\xE1\xBA\x89",
+    ['y'] = "\xE1\xBB\xB5", ['z'] = "\xE1\xBA\x93",
+};
+
+/* \b, macron below */
+static const gchar * const barbelow [128] = {
+    ['B'] = "\xE1\xB8\x86", ['D'] = "\xE1\xB8\x8E", ['K'] = "\xE1\xB8\xB4",
+    ['L'] = "\xE1\xB8\xBA", ['N'] = "\xE1\xB9\x88", ['R'] = "\xE1\xB9\x9E",
+    ['T'] = "\xE1\xB9\xAE", ['Z'] = "\xE1\xBA\x94", ['b'] = "\xE1\xB8\x87",
+    ['d'] = "\xE1\xB8\x8F", ['h'] = "\xE1\xBA\x96", ['k'] = "\xE1\xB8\xB5",
+    ['l'] = "\xE1\xB8\xBB", ['n'] = "\xE1\xB9\x89", ['r'] = "\xE1\xB9\x9F",
+    ['t'] = "\xE1\xB9\xAF", ['z'] = "\xE1\xBA\x95",
+};
+
+/* indexed by the character of the command */
+static const Accent accents [128] = {
+    ['\''] = { acute, "\xCC\x81", "\xC2\xB4" },
+    ['`'] = { grave, "\xCC\x80", "`" },
+    ['^'] = { circumflex, "\xCC\x82", "^" },
+    ['\"'] = { diaeresis, "\xCC\x88", "\xC2\xA8" },
+    ['~'] = { tilde, "\xCC\x83", "~" },
+    ['='] = { macron, "\xCC\x84", "\xC2\xAF" },
+    ['.'] = { dot, "\xCC\x87", "\xCB\x99" },
+    ['u'] = { breve, "\xCC\x86", "\xCB\x98" },
+    ['v'] = { caron, "\xCC\x8C", "\xCB\x87" },
+    ['H'] = { hungarumlaut, "\xCC\x8B", "\xCB\x9D" },
+    ['r'] = { ring, "\xCC\x8A", "\xCB\x9A" },
+    ['c'] = { cedilla, "\xCC\xA7", "\xC2\xB8" },
+    ['k'] = { ogonek, "\xCC\xA8", "\xCB\x9B" },
+    ['d'] = { dotbelow, "\xCC\xA3", NULL },
+    ['b'] = { barbelow, "\xCC\xB1", NULL },
+};
+
+StringMapping commands [] = {
+    {"backslash",         "\\"},
+    {"textbackslash",     "\\"},
+    /* alone, dotless letters are written as plain ones */
+    {"i",                 "i"},
+    {"j",                 "j"},
+    {"l",                 "\xC5\x82"},
+    {"L",                 "\xC5\x81"},
+    {"o",                 "\xC3\xB8"},
+    {"O",                 "\xC3\x98"},
+    {"oe",                "\xC5\x93"},
+    {"OE",                "\xC5\x92"},
+    {"ae",                "\xC3\xA6"},
+    {"AE",                "\xC3\x86"},
+    {"aa",                "\xC3\xA5"},
+    {"AA",                "\xC3\x85"},
+    {"ss",                "\xC3\x9F"},
+    {"SS",                "SS"},
+    {"dh",                "\xC3\xB0"},
+    {"DH",                "\xC3\x90"},
+    {"dj",                "\xC4\x91"},
+    {"DJ",                "\xC4\x90"},
+    {"th",                "\xC3\xBE"},
+    {"TH",                "\xC3\x9E"},
+    {"ng",                "\xC5\x8B"},
+    {"NG",                "\xC5\x8A"},
+    {"S",                 "\xC2\xA7"},
+    {"P",                 "\xC2\xB6"},
+    {"dag",               "\xE2\x80\xA0"},
+    {"ddag",              "\xE2\x80\xA1"},
+    {"guillemotleft",     "\xC2\xAB"},
+    {"guillemotright",    "\xC2\xBB"},
+    {"flqq",              "\xC2\xAB"},
+    {"frqq",              "\xC2\xBB"},
+    {"guilsinglleft",     "\xE2\x80\xB9"},
+    {"guilsinglright",    "\xE2\x80\xBA"},
+    {"guilsingleft",      "<"},
+    {"guilsingright",     ">"},
+    {"quotedblbase",      "\xE2\x80\x9E"},
+    {"quotesinglbase",    "\xE2\x80\x9A"},
+    {"textquotedblleft",  "\xE2\x80\x9C"},
+    {"textquotedblright", "\xE2\x80\x9D"},
+    {"textquoteleft",     "\xE2\x80\x98"},
+    {"textquoteright",    "\xE2\x80\x99"},
+    {"textquestiondown",  "\xC2\xBF"},
+    {"textexclamdown",    "\xC2\xA1"},
+    {"textendash",        "\xE2\x80\x93"},
+    {"textemdash",        "\xE2\x80\x94"},
+    {"ldots",             "\xE2\x80\xA6"},
+    {"dots",              "\xE2\x80\xA6"},
+    {"textellipsis",      "\xE2\x80\xA6"},
+    {"textbullet",        "\xE2\x80\xA2"},
+    {"textdegree",        "\xC2\xB0"},
+    {"textperthousand",   "\xE2\x80\xB0"},
+    {"copyright",         "\xC2\xA9"},
+    {"textcopyright",     "\xC2\xA9"},
+    {"textregistered",    "\xC2\xAE"},
+    {"texttrademark",     "\xE2\x84\xA2"},
+    {"pounds",            "\xC2\xA3"},
+    {"pound",             "\xC2\xA3"},
+    {"texteuro",          "\xE2\x82\xAC"},
+    {"neg",               "\xC2\xAC"},
+    {"-",                 "\xC2\xAD"},
+    {"cdotp",             "\xC2\xB7"},
+    {",",                 "\xC2\xB8"},
+    {NULL, NULL}
+};
+
+/* letters without their dot, on which accents are put as well */
+#define DOTLESS_I "\xC4\xB1"
+#define DOTLESS_J "\xC8\xB7"
 
-    return table;
-}
 
 static GHashTable *
-initialize_mapping (StringMapping * map) {
+commands_table (void) {
+    static gsize table = 0;
+    StringMapping * map;
     GHashTable * dico;
-    
-    dico = g_hash_table_new (g_str_hash, g_str_equal);
-    
-    while (map->c != NULL) {
-	g_hash_table_insert (dico, map->c, map->m);
-	map ++;
+
+    if (g_once_init_enter (& table)) {
+	dico = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (map = commands; map->c != NULL; map ++) {
+	    g_hash_table_insert (dico, map->c, map->m);
+	}
+
+	g_once_init_leave (& table, (gsize) dico);
     }
 
-    return dico;
+    return (GHashTable *) table;
 }
 
-static gchar *
-eat_as_string (GList ** flow,
-	       gint qtt,
+/* Render the next element of the flow, the argument of an accent */
+static void
+eat_as_string (BibtexStructFlow * flow,
+	       GString * out,
 	       gboolean * loss) {
 
     BibtexStruct * tmp_s;
-    gchar * tmp, * text = g_strdup ("");
-
-    g_return_val_if_fail (qtt > 0, text);
 
-    if (flow == NULL) {
-	return text;
-    }
+    if (flow == NULL) return;
 
-    while (qtt > 0 && (* flow)) {
-	tmp = text;
-	tmp_s = (BibtexStruct *) ((* flow)->data);
-	* flow = (* flow)->next;
+    while (flow->next < flow->end) {
+	tmp_s = * (flow->next ++);
 
 	if (tmp_s->type == BIBTEX_STRUCT_SPACE) continue;
 
-	qtt --;
-
-	text = g_strconcat (text, 
-			    bibtex_struct_as_string (tmp_s, BIBTEX_OTHER,
-						     NULL, loss),
-			    NULL);
-	g_free (tmp);
+	bibtex_struct_write_string (tmp_s, out, BIBTEX_OTHER, NULL, loss);
+	break;
     }
-
-    return text;
 }
 
-gchar * 
-bibtex_to_latin1 (BibtexStruct * s, 
-		      GList ** flow,
-		      gboolean * loss) {
-    
-    static gchar * acute_table = NULL;
-    static gchar * grave_table = NULL;
-    static gchar * hat_table = NULL;
-    static gchar * trema_table = NULL;
-    static gchar * cedilla_table = NULL;
-    static gchar * tilda_table = NULL;
-
-    static GHashTable * commands_table = NULL;
+/* Put the accent on the first character written in out after start */
+static void
+put_accent (const Accent * accent,
+	    GString * out,
+	    gsize start,
+	    gboolean * loss) {
 
-    gchar * text, * tmp, accent;
+    const gchar * first, * composed = NULL;
+    gsize length = 0;
 
-    g_return_val_if_fail (s != NULL, NULL);
-    g_return_val_if_fail (s->type == BIBTEX_STRUCT_COMMAND, NULL);
+    if (start == out->len) {
+	if (accent->alone) {
+	    g_string_append (out, accent->alone);
+	}
+	else {
+	    if (loss) * loss = TRUE;
+	}
+	return;
+    }
 
-    if (acute_table == NULL) {
-	/* Initialize accent table if necessary */
+    first = out->str + start;
 
-	acute_table    = initialize_table   (acute,   '');
-	grave_table    = initialize_table   (grave,   '\0');
-	hat_table      = initialize_table   (hat,     '\0');
-	trema_table    = initialize_table   (trema,   '');
-	cedilla_table  = initialize_table   (cedilla, '\0');
-	tilda_table    = initialize_table   (tilda,   '\0');
+    if ((guchar) first [0] < 128) {
+	composed = accent->table [(guchar) first [0]];
+	length   = 1;
+    }
+    else if (strncmp (first, DOTLESS_I, 2) == 0) {
+	composed = accent->table ['i'];
+	length   = 2;
+    }
+    else if (strncmp (first, DOTLESS_J, 2) == 0) {
+	composed = accent->table ['j'];
+	length   = 2;
+    }
 
-	commands_table = initialize_mapping (commands);
+    if (composed) {
+	g_string_erase  (out, start, length);
+	g_string_insert (out, start, composed);
+	return;
     }
 
-    /* traiter les codes de 1 de long */
-    if (strlen (s->value.com) == 1) {
-	accent = s->value.com [0];
+    length = MIN (g_utf8_next_char (first) - out->str, (gssize) out->len);
+    g_string_insert (out, length, accent->combining);
+}
 
-	if (accent == 'i') {
-	    return g_strdup ("i");
-	}
+void
+bibtex_accent_write (BibtexStruct * s, 
+		     BibtexStructFlow * flow,
+		     GString * out,
+		     gboolean * loss) {
+    const gchar * text;
+    guchar command;
+    gsize start;
+
+    g_return_if_fail (s != NULL);
+    g_return_if_fail (s->type == BIBTEX_STRUCT_COMMAND);
+    g_return_if_fail (out != NULL);
+
+    command = s->value.com [0];
+
+    /* traiter les codes de 1 de long */
+    if (command < 128 && s->value.com [1] == '\0') {
 
 	/* Is it a known accent ? */
-	if (accent == '\'' ||
-	    accent == '^'  ||
-	    accent == '`'  ||
-	    accent == '"'  ||
-	    accent == '~'  ||
-	    accent == 'c') {
-	    
-	    text = eat_as_string (flow, 1, loss);
-
-	    tmp  = NULL;
-
-	    switch (accent) {
-	    case '\'':
-		tmp = acute_table;
-		break;
-	    case '`':
-		tmp = grave_table;
-		break;
-	    case '^':
-		tmp = hat_table;
-		break;
-	    case '"':
-		tmp = trema_table;
-		break;
-	    case 'c':
-		tmp = cedilla_table;
-		break;
-	    case '~':
-		tmp = tilda_table;
-		break;
-		
-	    default:
-		g_assert_not_reached ();
-		break;
-	    }
-	    
-	    /* We know how to convert */
-	    if (tmp [(int) text [0]] != 0) {
-		if (text [0]) {
-		    text [0] = tmp [(int) text [0]];
-		}
-		else {
-		    tmp = g_strdup_printf ("%c", tmp [(int)text [0]]);
-		    g_free (text);
-		    text = tmp;
-		}
-	    }
-	    else {
-		if (loss) * loss = TRUE;
-	    }
+	if (accents [command].table) {
+	    start = out->len;
 
-	    return text;
+	    eat_as_string (flow, out, loss);
+	    put_accent (& accents [command], out, start, loss);
+
+	    return;
 	}
-	else {
-	    /* return the single symbol */
-	    if (! isalnum (s->value.com [0])) {
-		return g_strdup (s->value.com);
-	    }
+
+	/* return the single symbol */
+	if (! g_ascii_isalnum (command)) {
+	    g_string_append_c (out, command);
+	    return;
 	}
     }
 
     /* if not found, use dictionnary to eventually map */
-    text = g_hash_table_lookup (commands_table, s->value.com);
+    text = g_hash_table_lookup (commands_table (), s->value.com);
 
     if (text) {
-      return g_strdup (text);
+	g_string_append (out, text);
+	return;
     }
 
     if (loss) * loss = TRUE;
     bibtex_warning ("unable to convert `\\%s'", s->value.com);
 
-    return g_strdup (s->value.com);
+    g_string_append (out, s->value.com);
 }
 
 gchar *
-bibtex_accent_string(BibtexStruct * s, 
-		      GList ** flow,
+bibtex_accent_string (BibtexStruct * s, 
+		      BibtexStructFlow * flow,
 		      gboolean * loss) {
+    GString * text = g_string_new (NULL);
+
+    bibtex_accent_write (s, flow, text, loss);
+
+    return g_string_free (text, FALSE);
+}
+
+
+/* -------------------------------------------------- */
+
+/* ASCII characters that have to be escaped in LaTeX text */
+#define LATEX_SPECIALS "{}#$%&_\\"
+
+static void
+add_latex (GHashTable * table,
+	   const gchar * utf8,
+	   gchar * latex) {
+    gunichar c;
+
+    /* only single characters beyond ASCII are worth translating */
+    if ((guchar) utf8 [0] < 128 || * g_utf8_next_char (utf8) != '\0') {
+	g_free (latex);
+	return;
+    }
+
+    c = g_utf8_get_char (utf8);
+
+    /* the first way to write a character is kept */
+    if (g_hash_table_lookup (table, GUINT_TO_POINTER (c))) {
+	g_free (latex);
+	return;
+    }
+
+    g_hash_table_insert (table, GUINT_TO_POINTER (c), latex);
+}
+
+/* 
+   The LaTeX writing of the characters beyond ASCII, built from the
+   tables used to read it: named letters and symbols first, then the
+   accented letters.
+*/
+static GHashTable *
+latex_table (void) {
+    static gsize table = 0;
+    StringMapping * map;
+    GHashTable * dico;
+    const Accent * accent;
+    guint a, l;
+
+    if (g_once_init_enter (& table)) {
+	dico = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	add_latex (dico, "\xC2\xA0", g_strdup ("~"));
+	add_latex (dico, DOTLESS_I, g_strdup ("{\\i}"));
+	add_latex (dico, DOTLESS_J, g_strdup ("{\\j}"));
+
+	for (map = commands; map->c != NULL; map ++) {
+	    if (! g_ascii_isalpha (map->c [0])) continue;
+
+	    add_latex (dico, map->m, g_strdup_printf ("{\\%s}", map->c));
+	}
+
+	for (a = 0; a < 128; a ++) {
+	    accent = & accents [a];
+	    if (accent->table == NULL) continue;
+
+	    for (l = 0; l < 128; l ++) {
+		if (accent->table [l] == NULL) continue;
+
+		if (l == 'i' || l == 'j') {
+		    /* accents go on the dotless letters */
+		    add_latex (dico, accent->table [l],
+			       g_strdup_printf ("\\%c{\\%c}", a, l));
+		}
+		else if (g_ascii_isalpha (a)) {
+		    add_latex (dico, accent->table [l],
+			       g_strdup_printf ("\\%c{%c}", a, l));
+		}
+		else {
+		    add_latex (dico, accent->table [l],
+			       g_strdup_printf ("\\%c%c", a, l));
+		}
+	    }
+	}
+
+	g_once_init_leave (& table, (gsize) dico);
+    }
 
-    gchar * utf8_string;
-    gchar * latin1_string;
-    static RECODE_OUTER   outer   = NULL;
-    static RECODE_REQUEST request = NULL;
+    return (GHashTable *) table;
+}
+
+void
+bibtex_latex_write (const gchar * text,
+		    gssize length,
+		    GString * out) {
+    GHashTable * table;
+    const gchar * current, * end, * start, * latex;
+    gunichar c;
 
+    g_return_if_fail (text != NULL);
+    g_return_if_fail (out != NULL);
 
-    if (outer == NULL) {
-	outer = recode_new_outer (false);
-	g_assert (outer != NULL);
+    if (length < 0) {
+	length = strlen (text);
     }
 
-    if (request == NULL) {
-	request = recode_new_request (outer);
-	g_assert (request != NULL);
-	if (! recode_scan_request (request, "latin1..utf8")) {
-	    g_error ("can't create recoder");
+    table   = latex_table ();
+    current = text;
+    end     = text + length;
+
+    while (current < end) {
+	/* copy plain ASCII as a whole */
+	start = current;
+
+	while (current < end && (guchar) * current < 128 &&
+	       strchr (LATEX_SPECIALS, * current) == NULL) {
+	    current ++;
+	}
+
+	g_string_append_len (out, start, current - start);
+
+	if (current == end) break;
+
+	if (* current == '\\') {
+	    /* \\ would be a line break */
+	    g_string_append (out, "{\\textbackslash}");
+	    current ++;
+	    continue;
+	}
+
+	if ((guchar) * current < 128) {
+	    g_string_append_c (out, '\\');
+	    g_string_append_c (out, * (current ++));
+	    continue;
+	}
+
+	c = g_utf8_get_char_validated (current, end - current);
+
+	if (c == (gunichar) -1 || c == (gunichar) -2) {
+	    /* not UTF-8, kept as is */
+	    g_string_append_c (out, * (current ++));
+	    continue;
+	}
+
+	start   = current;
+	current = g_utf8_next_char (current);
+
+	latex = g_hash_table_lookup (table, GUINT_TO_POINTER (c));
+
+	if (latex) {
+	    g_string_append (out, latex);
+	}
+	else {
+	    g_string_append_len (out, start, current - start);
 	}
     }
+}
+
+gchar *
+bibtex_latex_string (const gchar * text) {
+    GString * out;
+
+    g_return_val_if_fail (text != NULL, NULL);
+
+    out = g_string_sized_new (strlen (text) + 16);
 
-    latin1_string = bibtex_to_latin1(s, flow, loss);
-    utf8_string = recode_string(request, latin1_string);
-    g_free(latin1_string);
+    bibtex_latex_write (text, -1, out);
 
-    return utf8_string;
+    return g_string_free (out, FALSE);
 }
 
 
@@ -36,39 +36,100 @@
 
 BibtexAuthorGroup *
 bibtex_author_group_new (void) {
-    return g_array_new (FALSE,
-			FALSE,
-			sizeof (BibtexAuthor));
+    BibtexAuthorGroup * group = g_new (BibtexAuthorGroup, 1);
+
+    group->len   = 0;
+    group->names = g_array_new (FALSE, FALSE, sizeof (BibtexAuthorNames));
+
+    /* offset 0 is taken, and stands for a missing name */
+    group->text  = g_string_new (NULL);
+    g_string_append_c (group->text, '\0');
+
+    return group;
 }
 
 void
 bibtex_author_group_destroy (BibtexAuthorGroup * group) {
-    unsigned int i;
-    BibtexAuthor * field;
-
     g_return_if_fail (group != NULL);
 
-    for (i = 0; i < group->len; i++) {
-	field = & g_array_index (group, BibtexAuthor, i);
-	
-	if (field->last) {
-	    g_free (field->last);
-	}
-	
-	if (field->first) {
-	    g_free (field->first);
-	}
-	
-	if (field->lineage) {
-	    g_free (field->lineage);
-	}
+    g_array_free (group->names, TRUE);
+    g_string_free (group->text, TRUE);
 
-	if (field->honorific) {
-	    g_free (field->honorific);
-	}
+    g_free (group);
+}
+
+static gchar *
+group_name (BibtexAuthorGroup * group,
+	    guint32 offset) {
+    return offset ? group->text->str + offset : NULL;
+}
+
+BibtexAuthor *
+bibtex_author_group_get (BibtexAuthorGroup * group,
+			 guint i,
+			 BibtexAuthor * author) {
+    BibtexAuthorNames * names;
+
+    g_return_val_if_fail (group != NULL, NULL);
+    g_return_val_if_fail (i < group->len, NULL);
+    g_return_val_if_fail (author != NULL, NULL);
+
+    names = & g_array_index (group->names, BibtexAuthorNames, i);
+
+    author->honorific = group_name (group, names->honorific);
+    author->first     = group_name (group, names->first);
+    author->last      = group_name (group, names->last);
+    author->lineage   = group_name (group, names->lineage);
+
+    return author;
+}
+
+/* Copy a name at the end of the text of the group */
+static guint32
+add_name (BibtexAuthorGroup * group,
+	  const gchar * name) {
+    guint32 offset;
+
+    if (name == NULL) return 0;
+
+    offset = group->text->len;
+    g_string_append_len (group->text, name, strlen (name) + 1);
+
+    return offset;
+}
+
+/* Join words with spaces at the end of the text of the group */
+static guint32
+join_names (BibtexAuthorGroup * group,
+	    GPtrArray * words) {
+    guint32 offset = group->text->len;
+    guint i;
+
+    for (i = 0; i < words->len && words->pdata [i] != NULL; i ++) {
+	if (i > 0) g_string_append_c (group->text, ' ');
+	g_string_append (group->text, words->pdata [i]);
     }
 
-    g_array_free (group, TRUE);
+    g_string_append_c (group->text, '\0');
+
+    return offset;
+}
+
+void
+bibtex_author_group_add (BibtexAuthorGroup * group,
+			 const BibtexAuthor * author) {
+    BibtexAuthorNames names;
+
+    g_return_if_fail (group != NULL);
+    g_return_if_fail (author != NULL);
+
+    names.honorific = add_name (group, author->honorific);
+    names.first     = add_name (group, author->first);
+    names.last      = add_name (group, author->last);
+    names.lineage   = add_name (group, author->lineage);
+
+    g_array_append_val (group->names, names);
+    group->len ++;
 }
 
 BibtexAuthor * 
@@ -114,61 +175,129 @@ bibtex_author_destroy (BibtexAuthor * field) {
    group... still needs some work !
    -------------------------------------------------- */
 
+/*
+  A word of the field once the pieces written without space between
+  them are put together, or a comma. Its level is that of its last
+  piece.
+*/
 typedef struct {
     gchar * text;
     guint level;
-} BTGroup;
+    gboolean comma;
+} BTToken;
 
-static BTGroup * 
-btgroup_new (gchar * text,
-	     guint level) {
-    BTGroup * group = g_new (BTGroup, 1);
+/* 
+   Everything needed to cut a field into tokens in a single pass. The
+   tokens of an author are handed over as soon as its `and' is met.
+*/
+typedef struct {
+    BibtexAuthorGroup * authors;
 
-    group->text = text;
-    group->level = level;
+    /* only the first max authors are extracted, if max > 0 */
+    guint max, total;
 
-    return group;
+    /* tokens of the current author, and what they hold */
+    GArray * tokens;
+    GStringChunk * strings;
+    gint comas;
+    gboolean any, words;
+
+    /* the word being built, if any */
+    GString * word;
+    gboolean in_word;
+    guint level;
+
+    /* room to render commands and sub-groups */
+    GString * scratch;
+} BTTokenizer;
+
+/* past the authors to extract, the others are only counted */
+#define COUNT_ONLY(tk) ((tk)->max > 0 && (tk)->total >= (tk)->max)
+
+static void end_author (BTTokenizer * tk, gboolean at_end);
+
+static void
+end_word (BTTokenizer * tk) {
+    BTToken token;
+
+    if (! tk->in_word) return;
+
+    if (tk->word->len == 3 && g_ascii_strcasecmp (tk->word->str, "and") == 0) {
+	end_author (tk, FALSE);
+    }
+    else {
+	tk->any   = TRUE;
+	tk->words = TRUE;
+
+	if (! COUNT_ONLY (tk)) {
+	    token.text  = g_string_chunk_insert_len (tk->strings, 
+						     tk->word->str, 
+						     tk->word->len);
+	    token.level = tk->level;
+	    token.comma = FALSE;
+
+	    g_array_append_val (tk->tokens, token);
+	}
+    }
+
+    g_string_truncate (tk->word, 0);
+    tk->in_word = FALSE;
 }
 
+/* a piece of text that is a single space or comma separates words */
 static void
-btgroup_destroy (BTGroup * group) {
-    g_free (group);
+add_piece (BTTokenizer * tk,
+	   const gchar * text,
+	   gsize length,
+	   guint level) {
+    BTToken token;
+
+    if (length == 1 && (text [0] == ' ' || text [0] == ',')) {
+	end_word (tk);
+
+	if (text [0] == ',') {
+	    tk->any = TRUE;
+	    tk->comas ++;
+
+	    if (! COUNT_ONLY (tk)) {
+		token.text  = ",";
+		token.level = level;
+		token.comma = TRUE;
+
+		g_array_append_val (tk->tokens, token);
+	    }
+	}
+	return;
+    }
+
+    g_string_append_len (tk->word, text, length);
+
+    tk->in_word = TRUE;
+    tk->level   = level;
 }
 
 /* this function adds the comma separated blocks to the token list */
 
-static GList *
-split_spaces (GList * tokens,
-	      gchar * data,
+static void
+split_spaces (BTTokenizer * tk,
+	      const gchar * data,
+	      gsize length,
 	      guint level) {
-    gchar * text, * courant, sep;
-    
-    text = data;
-    courant = data;
+    const gchar * courant = data, * end = data + length, * text;
 
-    while ((text = strchr (text, ',')) != NULL) {
-	sep  = * text;
-	* text = '\0';
-
-	if (strlen (courant) > 0) {
-	    tokens = g_list_append (tokens, 
-				    btgroup_new (g_strdup (courant), level));
+    while ((text = memchr (courant, ',', end - courant)) != NULL) {
+	if (text > courant) {
+	    add_piece (tk, courant, text - courant, level);
 	}
 
-	tokens = g_list_append (tokens, btgroup_new (g_strdup (","), level));
+	add_piece (tk, ",", 1, level);
 
-	* text = sep;
-	
-	text ++;
-	courant = text;
+	courant = text + 1;
     }
 
-    if (strlen (courant) > 0) {
-	tokens = g_list_append (tokens, 
-				btgroup_new (g_strdup (courant), level));
+    if (end > courant) {
+	add_piece (tk, courant, end - courant, level);
     }
-
-    return tokens;
 }
 
 
@@ -177,44 +306,44 @@ split_spaces (GList * tokens,
   ponctuation, sub-groups...)
 */
 
-static GList *
-tokenify (GList * tokens, 
+static void
+tokenify (BTTokenizer * tk,
 	  BibtexStruct * s,
 	  guint level,
-	  GHashTable * dico) {
+	  BibtexSource * source) {
 
-    GList * tmp;
-    gchar * text, * courant;
+    BibtexStructFlow flow;
     BibtexStruct * tmp_s;
 
     /* Aux niveaux plus levs, on considre les donnes d'un bloc */
     if (level > 1) {
-	text = bibtex_struct_as_string (s, BIBTEX_OTHER, dico, NULL);
-	tokens = g_list_append (tokens, btgroup_new (text, level));
+	g_string_truncate (tk->scratch, 0);
+	bibtex_struct_write_string (s, tk->scratch, BIBTEX_OTHER, source, NULL);
 
-	return tokens;
+	add_piece (tk, tk->scratch->str, tk->scratch->len, level);
+	return;
     }
 
     switch (s->type) {
 
     case BIBTEX_STRUCT_LIST:
-	tmp = s->value.list;
+	flow.next = s->value.list->items;
+	flow.end  = flow.next + s->value.list->length;
 
-	while (tmp != NULL) {
-	    tmp_s = (BibtexStruct *) tmp->data;
-	    tmp   = tmp->next;
+	while (flow.next < flow.end) {
+	    tmp_s = * (flow.next ++);
 
 	    /* Deal with eventual commands */
 	    switch (tmp_s->type) {
 	    case BIBTEX_STRUCT_COMMAND:
+		g_string_truncate (tk->scratch, 0);
+		bibtex_accent_write (tmp_s, & flow, tk->scratch, NULL);
 
-		courant = bibtex_accent_string (tmp_s, & tmp, NULL);
-		tokens  = split_spaces (tokens, courant, level);
-		g_free (courant);
+		split_spaces (tk, tk->scratch->str, tk->scratch->len, level);
 		break;
 		    
 	    default:
-		tokens = tokenify (tokens, tmp_s, level, dico);
+		tokenify (tk, tmp_s, level, source);
 		break;
 	    }
 	}
@@ -222,114 +351,83 @@ tokenify (GList * tokens,
 	break;
 	    
     case BIBTEX_STRUCT_TEXT:
-	tokens = split_spaces (tokens, s->value.text, level);
+	split_spaces (tk, s->value.text, strlen (s->value.text), level);
 	break;
 
     case BIBTEX_STRUCT_SPACE:
-	tokens = g_list_append (tokens, btgroup_new (g_strdup (" "), level));
+	add_piece (tk, " ", 1, level);
 	break;
 
     case BIBTEX_STRUCT_REF:
-	tmp_s = (BibtexStruct *) g_hash_table_lookup (dico, s->value.ref);
+	tmp_s = bibtex_source_get_string (source, s->value.ref);
 
 	if (tmp_s) {
-	    tokens = tokenify (tokens, tmp_s, level, dico);
+	    tokenify (tk, tmp_s, level, source);
 	}
 	break;
 	    
     case BIBTEX_STRUCT_SUB:
-	tokens = tokenify (tokens, s->value.sub->content, level + 1, dico);
+	tokenify (tk, s->value.sub->content, level + 1, source);
 	break;
 	
     case BIBTEX_STRUCT_COMMAND:
 	/* Normally, commands have been considered in STRUCT_LIST */
-	return NULL;
+	g_string_truncate (tk->scratch, 0);
+	bibtex_accent_write (s, NULL, tk->scratch, NULL);
+
+	split_spaces (tk, tk->scratch->str, tk->scratch->len, level);
 	break;
 	    
     default:
 	g_assert_not_reached ();
 	break;
     }
-
-    return tokens;
 }
 
 
 static void
-text_free (gpointer data,
-	   gpointer user) {
-    BTGroup * group;
-
-    group = (BTGroup *) data;
-    g_free (group->text);
-
-    btgroup_destroy (group);
-}
-
-
-void
 extract_author (BibtexAuthorGroup * authors,
-		GList * aut_elem) {
+		BTToken * aut_elem,
+		guint length,
+		gint comas) {
 
 #define SECTION_LENGTH 4
 
-    GList * tmp;
     gchar * text;
-    BibtexAuthor * author;
+    BibtexAuthorNames author;
     gint i;
-    gint sections, comas;
+    guint j;
+    gint sections;
     GPtrArray * section [SECTION_LENGTH], * array;
-    BTGroup * group;
+    BTToken * group;
 
     gint lastname_section;
 
-    /* Room for the new author */
-    g_array_set_size (authors, authors->len + 1);
-    author = & g_array_index (authors, BibtexAuthor, authors->len - 1);
-
-    author->first     = NULL;
-    author->last      = NULL;
-    author->honorific = NULL;
-    author->lineage   = NULL;
+    /* The new author, with no name yet */
+    author.first     = 0;
+    author.last      = 0;
+    author.honorific = 0;
+    author.lineage   = 0;
 
     for (i = 0; i < SECTION_LENGTH; i ++) {
 	section [i]  = g_ptr_array_new ();
     }
     
-    /* count the , */
-    tmp   = aut_elem;
-    comas = 0;
-
-    while (tmp) {
-	group = (BTGroup *) tmp->data;
-	text = group->text;
-
-	tmp = tmp->next;
-
-	/* Check for , syntax */
-	if (strcmp (",", text) == 0) {
-	  comas ++;
-	}
-    }
-
 /*      g_message ("%d comas", comas); */
 
     /* Parse the list into several groups */
 
-    tmp      = aut_elem;
     array    = section [0];
     sections = 0;
 
     lastname_section = -1;
 
-    while (tmp) {
-	group = (BTGroup *) tmp->data;
+    for (j = 0; j < length; j ++) {
+	group = & aut_elem [j];
 	text = group->text;
 
-	tmp = tmp->next;
-
 	/* Check for , syntax */
-	if (strcmp (",", text) == 0) {
+	if (group->comma) {
 
 	    /* skip eventual empty sections */
 	    if (array->len) {
@@ -347,7 +445,7 @@ extract_author (BibtexAuthorGroup * authors,
 	/* If we have the particule in lowercase */
 	if (group->level == 1  &&
 	    comas == 0         &&
-	    islower (text [0]) && 
+	    islower ((guchar) text [0]) && 
 	    sections > 0       &&
 	    lastname_section == -1) {
 
@@ -395,7 +493,6 @@ extract_author (BibtexAuthorGroup * authors,
 	    g_ptr_array_free (section [i], TRUE);
 	}
 
-	g_array_set_size (authors, authors->len - 1);
 	return;
     }
 
@@ -406,10 +503,10 @@ extract_author (BibtexAuthorGroup * authors,
 	g_ptr_array_add (section [0], NULL);
 	g_ptr_array_add (section [1], NULL);
 
-	author->last  = g_strjoinv (" ", (gchar **) section [0]->pdata);
+	author.last  = join_names (authors, section [0]);
 
 	if (section [1]->len > 1) {
-	    author->first = g_strjoinv (" ", (gchar **) section [1]->pdata);
+	    author.first = join_names (authors, section [1]);
 	}
 	break;
 
@@ -433,10 +530,10 @@ extract_author (BibtexAuthorGroup * authors,
 	g_ptr_array_add(section[1], NULL);
 
 	if (section[0]->len > 1) {
-	    author->first = g_strjoinv(" ", (gchar**)section[0]->pdata);
+	    author.first = join_names (authors, section [0]);
 	}
 
-	author->last  = g_strjoinv(" ", (gchar**)section[lastname_section]->pdata);
+	author.last  = join_names (authors, section [lastname_section]);
 	break;
 
     case 2:
@@ -445,9 +542,9 @@ extract_author (BibtexAuthorGroup * authors,
 	g_ptr_array_add (section [1], NULL);
 	g_ptr_array_add (section [2], NULL);
 
-	author->last    = g_strjoinv (" ", (gchar **) section [0]->pdata);
-	author->lineage = g_strjoinv (" ", (gchar **) section [1]->pdata);
-	author->first   = g_strjoinv (" ", (gchar **) section [2]->pdata);
+	author.last    = join_names (authors, section [0]);
+	author.lineage = join_names (authors, section [1]);
+	author.first   = join_names (authors, section [2]);
 	break;
 
     default:
@@ -457,176 +554,100 @@ extract_author (BibtexAuthorGroup * authors,
 	g_ptr_array_add (section [0], NULL);
 	g_ptr_array_add (section [1], NULL);
 
-	author->last  = g_strjoinv (" ", (gchar **) section [0]->pdata);
+	author.last  = join_names (authors, section [0]);
 
 	if (section [1]->len > 1) {
-	    author->first = g_strjoinv (" ", (gchar **) section [1]->pdata);
+	    author.first = join_names (authors, section [1]);
 	}
 	break;
     }
 
+    g_array_append_val (authors->names, author);
+    authors->len ++;
+
     for (i = 0; i < SECTION_LENGTH; i ++) {
 	g_ptr_array_free (section [i], TRUE);
     }
 }
 
-BibtexAuthorGroup *
-bibtex_author_parse (BibtexStruct * s,
-		     GHashTable * dico) {
-
-    GList * list = NULL, * toremove;
-
-    BibtexAuthorGroup * authors;
-    GList * tokens, * aut_elem;
-    gchar * text;
-    gboolean skip;
-    GList * target;
-    BTGroup * group, * tmp_g;
-    gboolean compact;
-
+/* The current author is complete */
+static void
+end_author (BTTokenizer * tk,
+	    gboolean at_end) {
 
-    g_return_val_if_fail (s != NULL, NULL);
+    if (! tk->any) {
+	if (at_end) {
+	    bibtex_warning ("`and' at end of author field");
+	}
+	else {
+	    bibtex_warning ("double `and' in author field");
+	}
+    }
+    else {
+	if (! COUNT_ONLY (tk)) {
+	    extract_author (tk->authors, (BTToken *) tk->tokens->data, 
+			    tk->tokens->len, tk->comas);
+	}
 
-    authors = bibtex_author_group_new ();
+	/* without any word, there is no author at all */
+	if (tk->words) tk->total ++;
+    }
 
-    /* --------------------------------------------------
-       Split into elementary tokens 
-       -------------------------------------------------- */
+    g_array_set_size (tk->tokens, 0);
+    g_string_chunk_clear (tk->strings);
 
-    tokens = tokenify (NULL, s, 0, dico);
-    list = tokens;
+    tk->comas = 0;
+    tk->any   = FALSE;
+    tk->words = FALSE;
+}
 
-    while (list) {
-	group = (BTGroup *) list->data;
+BibtexAuthorGroup *
+bibtex_author_parse_n (BibtexStruct * s,
+		       BibtexSource * source,
+		       guint max,
+		       guint * total) {
 
-	list = list->next;
-    }
+    BTTokenizer tk;
 
-    /* --------------------------------------------------
-       Compact the strings as much as possible 
-       -------------------------------------------------- */
-    compact    = FALSE;
-
-    while (! compact) {
-	compact = TRUE;
-	list = tokens;
-	toremove = NULL;
-	skip = TRUE;
-	target = NULL;
-	
-	/* For every token... */
-	while (list) {
-	    group = (BTGroup *) list->data;
-	    text = group->text;
-	    
-	    /* Skip and remove spaces */
-	    if (strcmp (" ", text) == 0) {
-		skip = TRUE;
-		list = list->next;
-		continue;
-	    }
+    g_return_val_if_fail (s != NULL, NULL);
 
-	    /* Skip commas */
-	    if (strcmp (",", text) == 0) {
-		skip = TRUE;
-		list = list->next;
-		continue;
-	    }
-	    
-	    /* Merge non separated entries */
-	    if (! skip) {
-		compact = FALSE;
-		toremove = g_list_append (toremove, group);
-		
-		g_assert (target != NULL);
-		
-		/* Update data */
-		tmp_g = (BTGroup *) target->data;
-		target->data = btgroup_new (g_strconcat (tmp_g->text, 
-							 text, NULL),
-					    group->level);
-		btgroup_destroy (tmp_g);
-
-		list = list->next;
-	    }
-	    else {
-		/* Get next entry */
-		skip = FALSE;
-		target = list;
-		list = list->next;
-	    }
-	}
-	
-	/* If there has been no compacting, remove spaces */
-	if (compact) {
-	    list = tokens;
-	    
-	    /* For every token... */
-	    while (list) {
-		group = (BTGroup *) list->data;
-		text = group->text;
-		
-		if (strcmp (" ", text) == 0) {
-		    toremove = g_list_append (toremove, group);
-		}
-		list = list->next;
-	    }
-	}
+    tk.authors = bibtex_author_group_new ();
+    tk.max     = max;
+    tk.total   = 0;
 
-	/* Remove items no more used */
-	list = toremove;
-	while (list) {
-	    /* Remove current from list */
-	    tokens = g_list_remove (tokens, list->data);
-	    
-	    text_free (list->data, NULL);
-	    list = list->next;
-	}
-	g_list_free (toremove);
+    tk.tokens  = g_array_new (FALSE, FALSE, sizeof (BTToken));
+    tk.strings = g_string_chunk_new (256);
+    tk.comas   = 0;
+    tk.any     = FALSE;
+    tk.words   = FALSE;
 
-	/* ...and eventually start again */
-    }
+    tk.word    = g_string_new (NULL);
+    tk.scratch = g_string_new (NULL);
+    tk.in_word = FALSE;
+    tk.level   = 0;
 
     /* --------------------------------------------------
-       Heuristic to extract authors... 
+       Split into words and commas, and extract the authors
+       on the way, in a single pass
        -------------------------------------------------- */
 
-    aut_elem = NULL;	
-    list = tokens;
+    tokenify (& tk, s, 0, source);
 
-    while (list) {
-	group = (BTGroup *) list->data;
-	text = group->text;
+    end_word   (& tk);
+    end_author (& tk, TRUE);
 
-	list = list->next;
+    g_array_free (tk.tokens, TRUE);
+    g_string_chunk_free (tk.strings);
+    g_string_free (tk.word, TRUE);
+    g_string_free (tk.scratch, TRUE);
 
-	if (g_ascii_strcasecmp (text, "and") == 0) {
-	    if (aut_elem == NULL) {
-		bibtex_warning ("double `and' in author field");
-	    }
-	    else {
-		extract_author (authors, aut_elem);
-		
-		g_list_free (aut_elem);
-		aut_elem = NULL;
-	    }
-	}
-	else {
-	    aut_elem = g_list_append (aut_elem, group);
-	}
-    }
+    if (total) * total = tk.total;
 
-    /* Extract last author */
-    if (aut_elem == NULL) {
-	bibtex_warning ("`and' at end of author field");
-    }
-    else {
-	extract_author (authors, aut_elem);
-	g_list_free (aut_elem);
-    }
-
-    g_list_foreach (tokens, text_free, NULL);
-    g_list_free (tokens);
+    return tk.authors;
+}
 
-    return authors;
+BibtexAuthorGroup *
+bibtex_author_parse (BibtexStruct * s,
+		     BibtexSource * source) {
+    return bibtex_author_parse_n (s, source, 0, NULL);
 }
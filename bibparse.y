@@ -29,32 +29,37 @@
 #include "bibtex.h"
 
 extern void bibtex_parser_initialize (BibtexSource *);
-extern void bibtex_parser_continue (BibtexSource *);
+extern void bibtex_parser_continue (BibtexSource *, BibtexParser *);
 extern void bibtex_parser_finish (BibtexSource *);
+extern void bibtex_parser_seek (BibtexSource *, gint);
 
-extern int bibtex_parser_lex (void);
+union YYSTYPE;
+extern int bibtex_parser_lex (union YYSTYPE *, void *);
 
-int bibtex_parser_parse (void);
-
-extern gboolean bibtex_parser_is_content;
+int bibtex_parser_parse (BibtexParser *, void *);
 
 extern int bibtex_parser_debug;
 
-static BibtexEntry *	entry	= NULL;
-static int		start_line, entry_start;
-static BibtexSource *	current_source;
-static gchar *	        error_string = NULL;
-static gchar *	        warning_string = NULL;
-static GString *        tmp_string = NULL;
-
 static void 
 nop (void) { 
     return ;
 }
 
-void 
-bibtex_next_line (void) { 
-    entry->length ++; 
+/* Content of an empty text */
+static BibtexStruct *
+empty_text (void) {
+    BibtexStruct * s = bibtex_struct_new (BIBTEX_STRUCT_TEXT);
+
+    s->value.text = bibtex_strndup ("", 0);
+
+    return s;
+}
+
+/* case insensitive comparison of a token with a keyword */
+static gboolean
+token_is (BibtexToken token, const gchar * keyword) {
+    return (token.length == strlen (keyword) &&
+	    g_ascii_strncasecmp (token.text, keyword, token.length) == 0);
 }
 
 void 
@@ -67,144 +72,196 @@ bibtex_analyzer_finish (BibtexSource * source)  {
     g_return_if_fail (source != NULL);
 
     bibtex_parser_finish (source);
-    
-    current_source = NULL;
+}
+
+void 
+bibtex_analyzer_seek (BibtexSource * source, gint offset)  {
+    g_return_if_fail (source != NULL);
+
+    bibtex_parser_seek (source, offset);
 }
  
 BibtexEntry * 
 bibtex_analyzer_parse (BibtexSource * source) {
   int ret;
   gboolean is_comment;
+  BibtexParser parser;
+  BibtexRegion * previous;
 
   g_return_val_if_fail (source != NULL, NULL);
 
-  if (! tmp_string) {
-      tmp_string = g_string_new (NULL);
-  }
+  parser.source = source;
 
-  current_source = source;
+  /*
+     Bison traces through a single global flag, shared by the parsers
+     of every thread. It is only ever switched on, once, by the first
+     source in debug mode, and never cleared: from then on, every
+     parse is traced.
+  */
+  if (source->debug && ! g_atomic_int_get (& bibtex_parser_debug)) {
+      g_atomic_int_set (& bibtex_parser_debug, 1);
+  }
 
-  bibtex_parser_debug = source->debug;
+  parser.start_line  = source->line;
+  parser.entry_start = source->line;
 
-  start_line  = source->line;
-  entry_start = source->line + 1;
+  parser.error_string   = NULL;
+  parser.warning_string = NULL;
 
-  entry = bibtex_entry_new ();
+  parser.entry = bibtex_entry_new ();
 
-  bibtex_parser_continue (source);
-  bibtex_parser_is_content = FALSE;
+  bibtex_parser_continue (source, & parser);
+  parser.is_content = FALSE;
+  parser.raw_line   = 0;
 
-  ret = bibtex_parser_parse ();
+  /* the structures of the entry go to the region of the source */
+  previous = bibtex_region_set_current (source->region);
+  ret = bibtex_parser_parse (& parser, source->scanner);
+  bibtex_region_set_current (previous);
 
-  entry->start_line = entry_start;
+  parser.entry->start_line = parser.entry_start;
 
-  bibtex_tmp_string_free ();
+  bibtex_tmp_string_free (source);
 
-  is_comment = (entry->type && (strcasecmp (entry->type, "comment") == 0));
+  is_comment = (parser.entry->type == bibtex_comment_quark ());
 
-  if (warning_string && ! is_comment) {
-      bibtex_warning ("%s", warning_string);
+  if (parser.warning_string && ! is_comment) {
+      bibtex_warning ("%s", parser.warning_string);
   }
   
   if (ret != 0) {
-      source->line += entry->length;
+      source->line += parser.entry->length;
       
-      if (error_string && ! is_comment) {
-	  bibtex_error ("%s", error_string);
+      if (parser.error_string && ! is_comment) {
+	  bibtex_error ("%s", parser.error_string);
       }
 
-      bibtex_entry_destroy (entry, TRUE);
-      entry = NULL;
+      bibtex_entry_destroy (parser.entry, TRUE);
+      parser.entry = NULL;
   }
 
-  if (error_string) {
-      g_free (error_string);
-      error_string = NULL;
+  if (parser.error_string) {
+      g_free (parser.error_string);
   }
 
-  if (warning_string) {
-      g_free (warning_string);
-      warning_string = NULL;
+  if (parser.warning_string) {
+      g_free (parser.warning_string);
   }
 
-  return entry;
+  return parser.entry;
 }
 
 void 
-bibtex_parser_error (char * s) {
-    if (error_string) {
-	g_free (error_string);
+bibtex_parser_error (BibtexParser * parser, 
+		     void * scanner G_GNUC_UNUSED, 
+		     const char * s) {
+    if (parser->error_string) {
+	g_free (parser->error_string);
     }
 
-    if (current_source) {
-	error_string = g_strdup_printf ("%s:%d: %s", current_source->name,
-					start_line + entry->length, s);
-    }
-    else {
-	error_string = g_strdup_printf ("%d: %s", 
-					start_line + entry->length, s);
+    parser->error_string = 
+	g_strdup_printf ("%s:%d: %s", parser->source->name,
+			 parser->start_line + parser->entry->length, s);
+}
 
+static void 
+bibtex_parser_warning (BibtexParser * parser, 
+		       const char * s) {
+    if (parser->warning_string) {
+	g_free (parser->warning_string);
     }
+
+    parser->warning_string = 
+	g_strdup_printf ("%s:%d: %s", parser->source->name,
+			 parser->start_line + parser->entry->length, s);
 }
 
-void 
-bibtex_parser_warning (char * s) {
-    if (current_source) {
-	warning_string = g_strdup_printf ("%s:%d: %s", current_source->name,
-					  start_line + entry->length, s);
+static void 
+bibtex_parser_start_error (BibtexParser * parser, 
+			   const char * s) {
+    if (parser->error_string) {
+	g_free (parser->error_string);
     }
-    else {
-	warning_string = g_strdup_printf ("%d: %s", 
-					  start_line + entry->length, s);
 
-    }
+    parser->error_string = 
+	g_strdup_printf ("%s:%d: %s", parser->source->name,
+			 parser->entry_start, s);
 }
 
 static void 
-bibtex_parser_start_error (char * s) {
-    if (error_string) {
-	g_free (error_string);
+bibtex_parser_start_warning (BibtexParser * parser, 
+			     const char * s) {
+    if (parser->warning_string) {
+	g_free (parser->warning_string);
     }
 
-    if (current_source) {
-	error_string = g_strdup_printf ("%s:%d: %s", current_source->name,
-					entry_start, s);
-    }
-    else {
-	error_string = g_strdup_printf ("%d: %s", 
-					entry_start, s);
-    }
+    parser->warning_string = 
+	g_strdup_printf ("%s:%d: %s", parser->source->name,
+			 parser->entry_start, s);
 }
 
-static void 
-bibtex_parser_start_warning (char * s) {
-    if (current_source) {
-	warning_string = g_strdup_printf ("%s:%d: %s", current_source->name,
-					  entry_start, s);
+/* Name of a new field of the entry */
+static GQuark
+field_name (BibtexParser * parser, BibtexToken token) {
+    gchar * tmp;
+    GQuark name;
+
+    name = bibtex_quark (token.text, token.length);
+
+    if (bibtex_entry_get_field (parser->entry, name)) {
+	tmp = g_strdup_printf ("field `%.*s' is already defined", 
+			       (int) token.length, token.text); 
+	bibtex_parser_warning (parser, tmp);
+	g_free (tmp);
     }
-    else {
-	warning_string = g_strdup_printf ("%d: %s", 
-					  entry_start, s);
+
+    return name;
+}
+
+static BibtexFieldType
+field_type (GQuark name) {
+    if (name == bibtex_author_quark ()) return BIBTEX_AUTHOR;
+    if (name == bibtex_title_quark ())  return BIBTEX_TITLE;
+    if (name == bibtex_year_quark ())   return BIBTEX_DATE;
+
+    return BIBTEX_OTHER;
+}
+
+/* Store a field in the entry, in place of a previous definition */
+static void
+set_field (BibtexParser * parser, GQuark name, BibtexField * field) {
+    BibtexField * previous;
+
+    previous = bibtex_entry_set_field (parser->entry, name, field);
+
+    if (previous) {
+	bibtex_field_destroy (previous, TRUE);
     }
 }
 
 %}	
 
+%define api.pure full
+%parse-param {BibtexParser * parser} {void * scanner}
+%lex-param {void * scanner}
+
 %union{
-    gchar * text;
+    BibtexToken token;
     BibtexStruct * body;
 }
 
 %token end_of_file
-%token <text> L_NAME
-%token <text> L_DIGIT
-%token <text> L_COMMAND
-%token <text> L_BODY
-%token <text> L_SPACE
-%token <text> L_UBSPACE
+%token <token> L_NAME
+%token <token> L_DIGIT
+%token <token> L_COMMAND
+%token <token> L_BODY
+%token <token> L_SPACE
+%token <token> L_UBSPACE
+%token <token> L_RAW
 
 %type <entry> entry
 %type <entry> values
+%type <entry> value_list
 %type <entry> value
 
 %type <body> content
@@ -222,7 +279,7 @@ bibtex_parser_start_warning (char * s) {
 entry:	  '@' L_NAME '{' values '}' 
 /* -------------------------------------------------- */
 {
-    entry->type = g_ascii_strdown($2, -1);
+    parser->entry->type = bibtex_quark ($2.text, $2.length);
 
     YYACCEPT; 
 }
@@ -230,7 +287,7 @@ entry:	  '@' L_NAME '{' values '}'
         | '@' L_NAME '(' values ')' 
 /* -------------------------------------------------- */
 { 
-    entry->type = g_ascii_strdown($2, -1);
+    parser->entry->type = bibtex_quark ($2.text, $2.length);
 
     YYACCEPT; 	
 }
@@ -238,28 +295,28 @@ entry:	  '@' L_NAME '{' values '}'
 	| end_of_file		    
 /* -------------------------------------------------- */
 { 
-    current_source->eof = TRUE; 
+    parser->source->eof = TRUE; 
     YYABORT; 
 }
 /* -------------------------------------------------- */
 	| '@' L_NAME '(' error ')'
 /* -------------------------------------------------- */
 {
-    if (strcasecmp ($2, "comment") == 0) {
-	entry->type = g_ascii_strdown($2, -1);
+    if (token_is ($2, "comment")) {
+	parser->entry->type = bibtex_quark ($2.text, $2.length);
 
 	yyclearin;
 	YYACCEPT;
     }
 
-    if (current_source->strict) {
-	bibtex_parser_start_error ("perhaps a missing coma");
+    if (parser->source->strict) {
+	bibtex_parser_start_error (parser, "perhaps a missing coma");
 	YYABORT;
     }
     else {
-	bibtex_parser_start_warning ("perhaps a missing coma.");
+	bibtex_parser_start_warning (parser, "perhaps a missing coma.");
 
-	entry->type = g_ascii_strdown($2, -1);
+	parser->entry->type = bibtex_quark ($2.text, $2.length);
 
 	yyclearin;
 	YYACCEPT;
@@ -269,21 +326,21 @@ entry:	  '@' L_NAME '{' values '}'
 	| '@' L_NAME '{' error '}'
 /* -------------------------------------------------- */
 {
-    if (strcasecmp ($2, "comment") == 0) {
-	entry->type = g_ascii_strdown($2, -1);
+    if (token_is ($2, "comment")) {
+	parser->entry->type = bibtex_quark ($2.text, $2.length);
 
 	yyclearin;
 	YYACCEPT;
     }
 
-    if (current_source->strict) {
-	bibtex_parser_start_error ("perhaps a missing coma");
+    if (parser->source->strict) {
+	bibtex_parser_start_error (parser, "perhaps a missing coma");
 	YYABORT;
     }
     else {
-	bibtex_parser_start_warning ("perhaps a missing coma");
+	bibtex_parser_start_warning (parser, "perhaps a missing coma");
 
-	entry->type = g_ascii_strdown($2, -1);
+	parser->entry->type = bibtex_quark ($2.text, $2.length);
 
 	yyclearin;
 	YYACCEPT;
@@ -293,14 +350,14 @@ entry:	  '@' L_NAME '{' values '}'
 	| '@' L_NAME '(' error end_of_file
 /* -------------------------------------------------- */
 {
-    bibtex_parser_start_error ("end of file during processing");
+    bibtex_parser_start_error (parser, "end of file during processing");
     YYABORT;
 }
 /* -------------------------------------------------- */
 	| '@' L_NAME '{' error end_of_file
 /* -------------------------------------------------- */
 {
-    bibtex_parser_start_error ("end of file during processing");
+    bibtex_parser_start_error (parser, "end of file during processing");
     YYABORT;
 }
 /* -------------------------------------------------- */
@@ -311,13 +368,25 @@ entry:	  '@' L_NAME '{' values '}'
 /* ================================================== */
 /* La liste des valeurs */
 /* -------------------------------------------------- */
-values:	  value ',' values
+values:	  value_list ','
 /* -------------------------------------------------- */
 {
     nop ();
 }
 /* -------------------------------------------------- */
-	| value	','
+	| value_list
+/* -------------------------------------------------- */
+{
+    nop ();
+}
+	;
+
+/* 
+   The lists are left recursive, so that the parser stack does not
+   grow with their length.
+*/
+/* ================================================== */
+value_list: value_list ',' value
 /* -------------------------------------------------- */
 {
     nop ();
@@ -338,57 +407,46 @@ values:	  value ',' values
 value:	  L_NAME '=' content 
 /* -------------------------------------------------- */
 { 
-    char * name;
+    GQuark name;
     BibtexField * field;
-    BibtexFieldType type = BIBTEX_OTHER;
-
-    name = g_ascii_strdown ($1, -1);
-    field = g_hash_table_lookup (entry->table, name);
 
-    /* Get a new instance of a field name */
-    if (field) {
-	g_string_printf (tmp_string, "field `%s' is already defined", $1); 
-	bibtex_parser_warning (tmp_string->str);
-    }
+    name = field_name (parser, $1);
 
-    /* Search its type */
-    do {
-	if (strcmp (name, "author") == 0) {
-	    type = BIBTEX_AUTHOR;
-	    break;
-	}
+    /* Convert into the right field */
+    field = bibtex_struct_as_field (bibtex_struct_flatten ($3),
+				    field_type (name));
 
-	if (strcmp (name, "title") == 0) {
-	    type = BIBTEX_TITLE;
-	    break;
-	}
+    set_field (parser, name, field);
+}
+/* -------------------------------------------------- */
+	| L_NAME L_RAW
+/* -------------------------------------------------- */
+{ 
+    GQuark name;
+    BibtexField * field;
 
-	if (strcmp (name, "year") == 0) {
-	    type = BIBTEX_DATE;
-	    break;
-	}
+    name = field_name (parser, $1);
 
-    } 
-    while (0);
+    /* The value is parsed when it is first needed */
+    field = bibtex_field_new (field_type (name));
 
-    /* Convert into the right field */
-    field = bibtex_struct_as_field (bibtex_struct_flatten ($3),
-				    type);
+    bibtex_field_set_raw (field, parser->source, $2.text, $2.length,
+			  parser->raw_line);
 
-    g_hash_table_replace(entry->table, name, field);
+    set_field (parser, name, field);
 }
 /* -------------------------------------------------- */
 	| content
 /* -------------------------------------------------- */
 { 
-    entry_start = start_line + entry->length;
+    parser->entry_start = parser->start_line + parser->entry->length;
 
-    if (entry->preamble) {
-	bibtex_parser_start_error ("entry already contains a preamble or has an unexpected comma in its key");
+    if (parser->entry->preamble) {
+	bibtex_parser_start_error (parser, "entry already contains a preamble or has an unexpected comma in its key");
 	YYABORT;
     }
 
-    entry->preamble = $1;
+    parser->entry->preamble = $1;
 }
 /* -------------------------------------------------- */
 	;
@@ -396,7 +454,7 @@ value:	  L_NAME '=' content
 
 
 /* ================================================== */
-content:    simple_content '#' content	
+content:    content '#' simple_content	
 /* -------------------------------------------------- */
 { 
     $$ = bibtex_struct_append ($1, $3);
@@ -415,15 +473,15 @@ content:    simple_content '#' content
 */
 
 /* ================================================== */
-content_brace: '{' { bibtex_parser_is_content = TRUE; }
+content_brace: '{' { parser->is_content = TRUE; }
 		text_brace '}'
 /* -------------------------------------------------- */
 { 
-    bibtex_parser_is_content = FALSE; 
+    parser->is_content = FALSE; 
     $$ = bibtex_struct_new (BIBTEX_STRUCT_SUB);
 
     $$->value.sub->encloser = BIBTEX_ENCLOSER_BRACE;
-    $$->value.sub->content  = $3;
+    $$->value.sub->content  = $3 ? $3 : empty_text ();
 } 
 ;
 
@@ -431,15 +489,15 @@ content_brace: '{' { bibtex_parser_is_content = TRUE; }
   Definition du contenu d'un champ encadre par des guillemets
 */
 /* ================================================== */
-content_quote: '"' { bibtex_parser_is_content = TRUE; }
+content_quote: '"' { parser->is_content = TRUE; }
 		text_quote '"'
 /* -------------------------------------------------- */
 { 
-    bibtex_parser_is_content = FALSE; 
+    parser->is_content = FALSE; 
     $$ = bibtex_struct_new (BIBTEX_STRUCT_SUB);
 
     $$->value.sub->encloser = BIBTEX_ENCLOSER_QUOTE;
-    $$->value.sub->content  = $3;
+    $$->value.sub->content  = $3 ? $3 : empty_text ();
 } 
 ;
 
@@ -448,14 +506,14 @@ simple_content:   L_DIGIT
 /* -------------------------------------------------- */
 { 
     $$ = bibtex_struct_new (BIBTEX_STRUCT_TEXT);
-    $$->value.text = g_strdup ($1);
+    $$->value.text = bibtex_strndup ($1.text, $1.length);
 }
 /* -------------------------------------------------- */
 	       | L_NAME 
 /* -------------------------------------------------- */
 {
     $$ = bibtex_struct_new (BIBTEX_STRUCT_REF);
-    $$->value.ref = g_strdup ($1);
+    $$->value.ref = bibtex_strndup ($1.text, $1.length);
 
     /* g_ascii_strdown ($$->value.ref, -1); */
 }
@@ -480,7 +538,7 @@ text_part: L_COMMAND
 /* -------------------------------------------------- */
 { 
     $$ = bibtex_struct_new (BIBTEX_STRUCT_COMMAND);
-    $$->value.com = g_strdup ($1 + 1);
+    $$->value.com = bibtex_strndup ($1.text + 1, $1.length - 1);
 }
 /* -------------------------------------------------- */
 	   | '{' text_brace '}'		
@@ -488,7 +546,7 @@ text_part: L_COMMAND
 { 
     $$ = bibtex_struct_new (BIBTEX_STRUCT_SUB);
     $$->value.sub->encloser = BIBTEX_ENCLOSER_BRACE;
-    $$->value.sub->content  = $2;
+    $$->value.sub->content  = $2 ? $2 : empty_text ();
 }
 /* -------------------------------------------------- */
 	       | L_SPACE
@@ -508,7 +566,7 @@ text_part: L_COMMAND
 /* -------------------------------------------------- */
 {
     $$ = bibtex_struct_new (BIBTEX_STRUCT_TEXT);
-    $$->value.text = g_strdup ($1);
+    $$->value.text = bibtex_strndup ($1.text, $1.length);
 }
 /* -------------------------------------------------- */
 	   ;
@@ -518,20 +576,19 @@ text_part: L_COMMAND
 text_brace:				
 /* -------------------------------------------------- */
 { 
-    $$ = bibtex_struct_new (BIBTEX_STRUCT_TEXT);
-    $$->value.text = g_strdup ("");
+    $$ = NULL;
 }
 /* -------------------------------------------------- */
-       | '"'  text_brace		
+       | text_brace '"'
 /* -------------------------------------------------- */
 { 
-    $$ = bibtex_struct_new (BIBTEX_STRUCT_TEXT);
-    $$->value.text = g_strdup ("\"");
+    BibtexStruct * quote = bibtex_struct_new (BIBTEX_STRUCT_TEXT);
+    quote->value.text = bibtex_strndup ("\"", 1);
 
-    $$ = bibtex_struct_append ($$, $2);
+    $$ = bibtex_struct_append ($1, quote);
 }
 /* -------------------------------------------------- */
-       | text_part text_brace 	
+       | text_brace text_part
 /* -------------------------------------------------- */
 { 
     $$ = bibtex_struct_append ($1, $2);
@@ -544,11 +601,10 @@ text_brace:
 text_quote:				
 /* -------------------------------------------------- */
 { 
-    $$ = bibtex_struct_new (BIBTEX_STRUCT_TEXT);
-    $$->value.text = g_strdup ("");
+    $$ = NULL;
 }
 /* -------------------------------------------------- */
-       | text_part text_quote 	
+       | text_quote text_part
 /* -------------------------------------------------- */
 { 
     $$ = bibtex_struct_append ($1, $2);
@@ -70,25 +70,79 @@ bibtex_set_default_handler (void) {
 }
 
 
-static void 
-add_to_dico (gpointer key, gpointer value, gpointer user) {
-    gchar * val = (gchar *) key;
-    BibtexField * field;
-    BibtexStruct * structure;
-
-    if ((structure = g_hash_table_lookup ((GHashTable *) user, val)) == NULL) {
-	val = g_strdup ((char *) key);
+/* messages kept aside by the current thread */
+static GPrivate deferred = G_PRIVATE_INIT (NULL);
+
+typedef struct {
+    GLogLevelFlags level;
+    gchar * text;
+}
+BibtexMessage;
+
+void
+bibtex_logv (GLogLevelFlags level,
+	     const gchar * format,
+	     va_list args) {
+    GQueue * queue = g_private_get (& deferred);
+    BibtexMessage * message;
+
+    if (queue == NULL) {
+	g_logv (G_LOG_DOMAIN, level, format, args);
+	return;
     }
-    else {
-	bibtex_struct_destroy (structure, TRUE);
+
+    message = g_new (BibtexMessage, 1);
+
+    message->level = level;
+    message->text  = g_strdup_vprintf (format, args);
+
+    g_queue_push_tail (queue, message);
+}
+
+void
+bibtex_log (GLogLevelFlags level,
+	    const gchar * format,
+	    ...) {
+    va_list args;
+
+    va_start (args, format);
+    bibtex_logv (level, format, args);
+    va_end (args);
+}
+
+void
+bibtex_messages_defer (GQueue * queue) {
+    g_private_set (& deferred, queue);
+}
+
+void
+bibtex_messages_flush (GQueue * queue, 
+		       gboolean emit) {
+    BibtexMessage * message;
+
+    g_return_if_fail (queue != NULL);
+
+    while ((message = g_queue_pop_head (queue)) != NULL) {
+	if (emit) {
+	    g_log (G_LOG_DOMAIN, message->level, "%s", message->text);
+	}
+
+	g_free (message->text);
+	g_free (message);
     }
+}
+
 
-    field = (BibtexField *) value;
+static gboolean 
+add_to_dico (BibtexSource * file, GQuark name, BibtexField * field) {
+    BibtexStruct * s = bibtex_field_get_structure (field);
 
-    gchar* c = val;
-    for (; *c != '\0'; *c = g_ascii_tolower(*c), c++);
+    if (s == NULL) return FALSE;
 
-    g_hash_table_insert ((GHashTable *) user, val, field->structure);
+    /* the names are already in lower case */
+    bibtex_source_set_string (file, (gchar *) g_quark_to_string (name), s);
+
+    return TRUE;
 }
 
 
@@ -98,6 +152,7 @@ bibtex_source_next_entry (BibtexSource * file,
     BibtexEntry * ent;
 
     int offset;
+    guint i, j;
 
     g_return_val_if_fail (file != NULL, NULL);
 
@@ -118,10 +173,24 @@ bibtex_source_next_entry (BibtexSource * file,
 	    
 	    /* Rajouter les definitions au dictionnaire, si necessaire */
 	    if (ent->type) {
-		if (strcasecmp (ent->type, "string") == 0) {
+		if (ent->type == bibtex_string_quark ()) {
+
+		    for (i = 0; i < ent->n_fields; i ++) {
+			if (! add_to_dico (file, ent->fields [i].name,
+					   ent->fields [i].field)) {
+			    /* the definitions before it are kept in the table */
+			    for (j = 0; j < ent->n_fields; j ++) {
+				bibtex_field_destroy (ent->fields [j].field,
+						      j >= i);
+			    }
+			    ent->n_fields = 0;
 
-		    g_hash_table_foreach (ent->table, add_to_dico, 
-					  file->table);
+			    bibtex_entry_destroy (ent, FALSE);
+			    file->error = TRUE;
+
+			    return NULL;
+			}
+		    }
 		    
 		    if (filter) {
 			/* Return nothing, we store it as string database */
@@ -131,14 +200,14 @@ bibtex_source_next_entry (BibtexSource * file,
 		}
 		else {
 		    do {
-			if (strcasecmp (ent->type, "comment") == 0) {
+			if (ent->type == bibtex_comment_quark ()) {
 			    bibtex_entry_destroy (ent, TRUE);
 			    ent = NULL;
 			    
 			    break;
 			}
 
-			if (strcasecmp (ent->type, "preamble") == 0) {
+			if (ent->type == bibtex_preamble_quark ()) {
 			    if (filter) {
 				bibtex_warning ("%s:%d: skipping preamble",
 						file->name, file->line);
@@ -35,11 +35,25 @@ extern "C" {
 #include <glib.h>
 #include "logging.h"
     
+    /* 
+       Memory allocated in bulk, and freed at once
+    */
+    typedef struct _BibtexRegion BibtexRegion;
+
+    /* 
+       Table indexed by names in any case, that can be looked up
+       with a span of text
+    */
+    typedef struct _BibtexDict BibtexDict;
+
     /* 
        General structure for BibTeX content storing
     */
     typedef struct _BibtexStruct BibtexStruct;
 
+    /* A text to parse entries from */
+    typedef struct _BibtexSource BibtexSource;
+
     typedef enum {
 	/* List holder */
 	BIBTEX_STRUCT_LIST,
@@ -69,11 +83,28 @@ extern "C" {
     }
     BibtexStructSub;
 
+    /* Children of a list, in a single block */
+    typedef struct {
+	guint length, allocated;
+	BibtexStruct * items [];
+    }
+    BibtexStructList;
+
+    /* The children of a list following a command, which it may use */
+    typedef struct {
+	BibtexStruct ** next;
+	BibtexStruct ** end;
+    }
+    BibtexStructFlow;
+
     struct _BibtexStruct {
 	BibtexStructType type;
 
+	/* the node and its content belong to a region */
+	gboolean in_region;
+
 	union {
-	    GList * list;
+	    BibtexStructList * list;
 	    gchar * text;
 	    gchar * ref;
 	    gchar * com;
@@ -104,9 +135,28 @@ extern "C" {
     }
     BibtexAuthor;
 
-    /* Group of authors */
+    /* 
+       Group of authors: all the names are packed in a single block of
+       text, and each author is only the offsets of its names in it
+    */
+    typedef struct {
+	guint32 honorific;
+	guint32 first;
+	guint32 last;
+	guint32 lineage;
+    }
+    BibtexAuthorNames;
+
+    typedef struct {
+	guint len;
+
+	/* one BibtexAuthorNames per author; an offset of 0 is no name */
+	GArray * names;
 
-    typedef GArray BibtexAuthorGroup;
+	/* the NUL terminated names, after an empty one at offset 0 */
+	GString * text;
+    }
+    BibtexAuthorGroup;
 
 
     /* Date */
@@ -122,39 +172,77 @@ extern "C" {
        General field declaration
     */
 
-    typedef struct {
+    typedef struct _BibtexField BibtexField;
+
+    struct _BibtexField {
 	gboolean converted;
 	gboolean loss;
 
+	/* the field itself belongs to a region */
+	gboolean in_region;
+
 	BibtexFieldType    type;
 	BibtexStruct *     structure;
 
+	/* text of a value not parsed yet, in its source */
+	const gchar *      raw;
+	gsize              raw_length;
+
+	/* where that text comes from, to report its errors */
+	const gchar *      raw_name;
+	gint               raw_line;
+
+	/* the source that text is in, which lists its lazy fields */
+	BibtexSource *     raw_source;
+	BibtexField *      raw_prev, * raw_next;
+
 	gchar * text;
 
+	/* 
+	   names of the macros the text was expanded from, in the
+	   structure, and when it was
+	*/
+	GPtrArray * macros;
+	guint    stamp;
+
 	union {
 	    BibtexAuthorGroup * author;
 	    BibtexDateField     date;
 	} field;
-    }
-    BibtexField;
+    };
 
     /*
       Full BibTeX entry
     */
 
+    /* A field of an entry, under its interned name */
+    typedef struct {
+	GQuark name;
+	BibtexField * field;
+    }
+    BibtexEntryField;
+
+    /* fields held in the entry itself, before a larger array is needed */
+    #define BIBTEX_ENTRY_FIELDS 12
+
     typedef struct {
 	int length;
 	int offset;
 
 	int start_line;
 
-	gchar * type;
+	/* interned, in lower case; 0 if unknown */
+	GQuark type;
 	gchar * name;
 	
 	BibtexStruct * preamble;
 	gchar * textual_preamble;
 
-	GHashTable * table;
+	/* sorted by name */
+	BibtexEntryField * fields;
+	guint n_fields, max_fields;
+
+	BibtexEntryField local [BIBTEX_ENTRY_FIELDS];
     } 
     BibtexEntry;
 
@@ -165,17 +253,22 @@ extern "C" {
     typedef enum {
 	BIBTEX_SOURCE_NONE,
 	BIBTEX_SOURCE_FILE,
-	BIBTEX_SOURCE_STRING
+	BIBTEX_SOURCE_STRING,
+	BIBTEX_SOURCE_MMAP
     }
     BibtexSourceType;
 
-    typedef struct {
+    struct _BibtexSource {
 	gboolean eof, error;
 	gboolean strict;
 
+	/* only keep the text of the values, if held in memory */
+	gboolean lazy;
+
 	int line;
 	int offset;
 
+	/* turns on the tracing of every parser, for good */
 	int debug;
 
 	BibtexSourceType type;
@@ -184,13 +277,55 @@ extern "C" {
 
 	union {
 	    FILE  * file;
-	    gchar * string;
+
+	    /* 
+	       text held in memory, copied by the source unless
+	       borrowed; scanned in place, or else on a copy
+	    */
+	    struct {
+		gchar  * text;
+		gsize    length;
+		gboolean borrowed;
+		gboolean in_place;
+	    } string;
+
+	    /* file content, followed by two NUL bytes */
+	    struct {
+		gchar * data;
+		gsize   length;
+	    } map;
 	} source;
 
-	GHashTable * table;
+	/* the @string definitions */
+	BibtexDict * table;
 	gpointer buffer;
-    }
-    BibtexSource;
+
+	/* rendered texts of the @string macros, see below */
+	GHashTable * expansions;
+
+	/* 
+	   When each macro last changed, and the macros using each
+	   macro: a change in one also changes those using it.
+	*/
+	BibtexDict * stamps;
+	BibtexDict * users;
+	guint serial;
+	gpointer scanner;
+
+	/* temporary strings of the entry being parsed */
+	GStringChunk * strings;
+
+	/* where the parsed structures are allocated, if not NULL */
+	BibtexRegion * region;
+
+	/* 
+	   The lazy fields whose text is in the source, and copies of
+	   those whose text was patched away in its file.
+	*/
+	BibtexField * raw_fields;
+	GStringChunk * raw_copies;
+	GMutex raw_lock;
+    };
 
     /* -------------------------------------------------- 
        High level interface
@@ -201,6 +336,24 @@ extern "C" {
     void          bibtex_entry_destroy  (BibtexEntry * entry, 
 					 gboolean content);
 
+    BibtexField * bibtex_entry_get_field (BibtexEntry * entry, 
+					  GQuark name);
+
+    /* returns the field previously known under that name, if any */
+    BibtexField * bibtex_entry_set_field (BibtexEntry * entry, 
+					  GQuark name,
+					  BibtexField * field);
+
+    /* Interned names of entry types and fields, in lower case */
+    GQuark        bibtex_quark (const gchar * text, gsize length);
+
+    GQuark        bibtex_string_quark   (void);
+    GQuark        bibtex_comment_quark  (void);
+    GQuark        bibtex_preamble_quark (void);
+    GQuark        bibtex_author_quark   (void);
+    GQuark        bibtex_title_quark    (void);
+    GQuark        bibtex_year_quark     (void);
+
 
     /* Source manipulation */
 
@@ -212,10 +365,53 @@ extern "C" {
     gboolean       bibtex_source_file (BibtexSource * source, gchar *
 				       filename);
 
+    gboolean       bibtex_source_mmap (BibtexSource * source, gchar *
+				       filename);
+
+    /* 
+       Map the file again once length bytes at offset were replaced,
+       what followed moving by shift bytes, and release the previous
+       mapping. Lazy fields follow their text, or keep a copy of it
+       when it was replaced: call bibtex_source_copy_raw before the
+       file changes. Both expect raw_lock to be held.
+    */
+    gboolean       bibtex_source_remap (BibtexSource * source,
+					gint offset, gint length, 
+					gint shift);
+
+    void           bibtex_source_copy_raw (BibtexSource * source,
+					   gint offset, gint length);
+
     gboolean       bibtex_source_string (BibtexSource * source, 
 					 gchar * name,
 					 gchar * string);
 
+    /* 
+       Parse length bytes of text, which is not copied: the caller
+       keeps it alive as long as the source. Lazy fields point in it.
+    */
+    gboolean       bibtex_source_buffer (BibtexSource * source, 
+					 gchar * name,
+					 const gchar * text,
+					 gsize length);
+
+    /* 
+       The same, on a text followed by two NUL bytes, which the
+       scanner works in directly: nothing is copied, but the text is
+       written into, so the source is never lazy.
+    */
+    gboolean       bibtex_source_scan (BibtexSource * source, 
+				       gchar * name,
+				       gchar * text,
+				       gsize length);
+
+    /* 
+       Allocate the fields and structures parsed from now on in a
+       region of the source. They are then only valid as long as the
+       source itself.
+    */
+    void           bibtex_source_use_region (BibtexSource * source);
+
     /* Manipulate @string definitions in that source */
     BibtexStruct * bibtex_source_get_string (BibtexSource * source,
 					     gchar * key);
@@ -224,9 +420,45 @@ extern "C" {
 					     gchar * key,
 					     BibtexStruct * value);
 
+    /* 
+       Changes of the definition of a macro, or of one it uses, are
+       counted by the source. A text computed when the serial of the
+       source was s is still valid if its macros have a stamp <= s.
+    */
+    guint          bibtex_source_get_stamp (BibtexSource * source,
+					    const gchar * macro);
+
+    /* 
+       Cache of the rendering of each macro, for every mode it is
+       rendered in. Changing any @string definition forgets it.
+    */
+    const gchar *  bibtex_source_get_expansion (BibtexSource * source,
+						BibtexStruct * macro,
+						guint mode,
+						gsize * length,
+						gboolean * loss);
+
+    void           bibtex_source_set_expansion (BibtexSource * source,
+						BibtexStruct * macro,
+						guint mode,
+						const gchar * text,
+						gsize length,
+						gboolean loss);
+
 
     BibtexEntry *  bibtex_source_next_entry (BibtexSource * file, gboolean filter);
 
+    /* 
+       Parse all the remaining entries at once. Sources held in memory
+       are split between several threads (0 for one per processor).
+       Returns the entries in file order. The parsing stops on the
+       first error, which leaves the source before its end: the
+       entries before the error are returned all the same.
+    */
+    GPtrArray *    bibtex_source_parse_all (BibtexSource * file, 
+					    gboolean filter,
+					    gint threads);
+
     void           bibtex_source_rewind (BibtexSource * file);
 
     gint           bibtex_source_get_offset (BibtexSource * file);
@@ -238,7 +470,54 @@ extern "C" {
 
     BibtexField * bibtex_field_new     (BibtexFieldType type);
     void          bibtex_field_destroy (BibtexField * field, gboolean content);
-    BibtexField * bibtex_field_parse   (BibtexField * field, GHashTable * dico);
+    /* converts again a field whose macros have changed since; NULL on error */
+    BibtexField * bibtex_field_parse   (BibtexField * field, BibtexSource * source);
+
+    /* 
+       the structure of the field, parsed on first use for a lazy one.
+       NULL if it has none, or if it can't be parsed: the error is then
+       reported, and the field is left as it was.
+    */
+    BibtexStruct * bibtex_field_get_structure (BibtexField * field);
+
+    /* 
+       Make a field lazy, on length bytes of text in source, or move a
+       lazy field to another source its text is in, or make it forget
+       its text.
+    */
+    void          bibtex_field_set_raw  (BibtexField * field,
+					 BibtexSource * source,
+					 const gchar * text, gsize length,
+					 gint line);
+    void          bibtex_field_move_raw (BibtexField * field,
+					 BibtexSource * source);
+    void          bibtex_field_drop_raw (BibtexField * field);
+
+    /* parse a value written as in a file, like {text} # macro */
+    BibtexStruct * bibtex_struct_parse (const gchar * text, gssize length);
+    /* the same, reporting errors at line of the file name */
+    BibtexStruct * bibtex_struct_parse_at (const gchar * text, gssize length,
+					   const gchar * name, gint line);
+
+    /* 
+       Writing back: the value of a field as in a file, the text of a
+       source as it is (up to its end for a negative length), or any
+       text. They return FALSE on error.
+    */
+    void          bibtex_field_write   (BibtexField * field, GString * out);
+    gboolean      bibtex_source_copy   (BibtexSource * source,
+					gint offset, gint length, int fd);
+    gboolean      bibtex_write_text    (int fd, const gchar * text, gsize length);
+
+    /* 
+       Replace length bytes at offset in the file of a source with
+       text. The source goes on parsing after that place, and shift
+       tells how much the entries after it have moved.
+    */
+    gboolean      bibtex_source_patch  (BibtexSource * source,
+					gint offset, gint length,
+					const gchar * text, gsize size,
+					gint * shift);
 
 
     /* Authors manipulation */
@@ -248,8 +527,26 @@ extern "C" {
 
     BibtexAuthorGroup * bibtex_author_group_new     (void);
     void                bibtex_author_group_destroy (BibtexAuthorGroup * authors);
+
+    /* the names of an author, pointing inside the group */
+    BibtexAuthor *      bibtex_author_group_get     (BibtexAuthorGroup * authors,
+						     guint i,
+						     BibtexAuthor * author);
+
+    /* add a copy of the names of author at the end of the group */
+    void                bibtex_author_group_add     (BibtexAuthorGroup * authors,
+						     const BibtexAuthor * author);
     BibtexAuthorGroup * bibtex_author_parse         (BibtexStruct * authors, 
-						     GHashTable * dico);
+						     BibtexSource * source);
+
+    /* 
+       Only the first max authors, and in total the number of authors
+       of the whole field, whose other names are not built
+    */
+    BibtexAuthorGroup * bibtex_author_parse_n       (BibtexStruct * authors, 
+						     BibtexSource * source,
+						     guint max,
+						     guint * total);
 
 
     /* Structure allocation / manipulation */
@@ -261,6 +558,9 @@ extern "C" {
     BibtexStruct * bibtex_struct_copy    (BibtexStruct * source);
     void           bibtex_struct_display (BibtexStruct * source);
     BibtexStruct * bibtex_struct_flatten (BibtexStruct * source);
+
+    /* add the names of the macros used in s to refs, once each */
+    void           bibtex_struct_get_refs (BibtexStruct * s, GPtrArray * refs);
     BibtexStruct * bibtex_struct_append  (BibtexStruct *, BibtexStruct *);
 
 
@@ -268,18 +568,33 @@ extern "C" {
 
     gchar *       bibtex_struct_as_string (BibtexStruct * s, 
 					   BibtexFieldType type, 
-					   GHashTable * dico,
+					   BibtexSource * source,
 					   gboolean * loss);
 
     gchar *       bibtex_struct_as_bibtex (BibtexStruct * s);
 
     gchar *       bibtex_struct_as_latex  (BibtexStruct * s,
 					   BibtexFieldType type,
-					   GHashTable * dico);
+					   BibtexSource * source);
 
     BibtexField * bibtex_struct_as_field  (BibtexStruct * s, 
 					   BibtexFieldType type);
 
+    /* the same conversions, appended to a buffer the caller may reuse */
+    void          bibtex_struct_write_string (BibtexStruct * s,
+					      GString * buffer,
+					      BibtexFieldType type, 
+					      BibtexSource * source,
+					      gboolean * loss);
+
+    void          bibtex_struct_write_bibtex (BibtexStruct * s,
+					      GString * buffer);
+
+    void          bibtex_struct_write_latex  (BibtexStruct * s,
+					      GString * buffer,
+					      BibtexFieldType type,
+					      BibtexSource * source);
+
 
     /* recreate structure after modifications */
 
@@ -287,16 +602,103 @@ extern "C" {
 					gboolean use_braces,
 					gboolean do_quote);
 
+    /* 
+       Same, for many fields of a single type at once, shared between
+       several threads (0 for one per processor).
+    */
+    void          bibtex_reverse_fields (GPtrArray * fields,
+					 gboolean use_braces,
+					 gboolean do_quote,
+					 gint threads);
+
     /* --------------------------------------------------
        Low level function
        -------------------------------------------------- */
 
-    gchar * bibtex_accent_string (BibtexStruct * s, GList ** flow, gboolean * loss);
+    /* UTF-8 text of a command, whose argument is taken from flow */
+    gchar * bibtex_accent_string (BibtexStruct * s, BibtexStructFlow * flow, 
+				  gboolean * loss);
+    void    bibtex_accent_write  (BibtexStruct * s, BibtexStructFlow * flow, 
+				  GString * out, gboolean * loss);
     void    bibtex_capitalize    (gchar * text, gboolean is_noun, gboolean at_start);
 
+    /* LaTeX writing of some UTF-8 text, the reverse of the above */
+    gchar * bibtex_latex_string  (const gchar * text);
+    void    bibtex_latex_write   (const gchar * text, gssize length, 
+				  GString * out);
+
+    /* Regions */
+    BibtexRegion * bibtex_region_new     (void);
+    void           bibtex_region_destroy (BibtexRegion * region);
+    gpointer       bibtex_region_alloc   (BibtexRegion * region, gsize size);
+    gchar *        bibtex_region_strndup (BibtexRegion * region, 
+					  const gchar * text, gsize length);
+
+    /* move all the memory of other into region, and free other */
+    void           bibtex_region_merge   (BibtexRegion * region, 
+					  BibtexRegion * other);
+
+    /* the region used by bibtex_alloc in the current thread */
+    BibtexRegion * bibtex_region_current     (void);
+    BibtexRegion * bibtex_region_set_current (BibtexRegion * region);
+
+    /* allocate in the current region, or with g_malloc if there is none */
+    gpointer       bibtex_alloc   (gsize size);
+    gchar *        bibtex_strndup (const gchar * text, gssize length);
+
+    /* 
+       Dictionaries: keys are compared and hashed in lower case, and
+       stored that way; a length of -1 stands for a NUL terminated key
+    */
+    BibtexDict *   bibtex_dict_new     (void);
+    void           bibtex_dict_destroy (BibtexDict * dict);
+
+    gpointer       bibtex_dict_lookup  (BibtexDict * dict, 
+					const gchar * text, gssize length);
+
+    /* returns the value previously set for that key, if any */
+    gpointer       bibtex_dict_insert  (BibtexDict * dict, 
+					const gchar * text, gssize length,
+					gpointer value);
+
+    guint          bibtex_dict_size    (BibtexDict * dict);
+
+    void           bibtex_dict_foreach (BibtexDict * dict, 
+					GHFunc func, gpointer user);
+
+    /* the same, then empty the dictionary */
+    void           bibtex_dict_foreach_steal (BibtexDict * dict, 
+					      GHFunc func, gpointer user);
+
     /* Temporary strings */
-    gchar * bibtex_tmp_string      (gchar *);
-    void    bibtex_tmp_string_free (void);
+    gchar * bibtex_tmp_string      (BibtexSource * source, 
+				    const gchar * text, gsize length);
+    void    bibtex_tmp_string_free (BibtexSource * source);
+
+    /* Text of a token, inside the scanner buffer: not NUL terminated */
+    typedef struct {
+	const gchar * text;
+	gsize length;
+    }
+    BibtexToken;
+
+    /* State of the parser while it reads a single entry */
+    typedef struct {
+	BibtexSource * source;
+	BibtexEntry  * entry;
+
+	int start_line, entry_start;
+
+	/* are we inside a braced or quoted text ? */
+	gboolean is_content;
+
+	/* line where the last value kept as raw text starts */
+	int raw_line;
+
+	gchar * error_string;
+	gchar * warning_string;
+    }
+    BibtexParser;
     
     /* Parse next entry */
     BibtexEntry * bibtex_analyzer_parse (BibtexSource * file);
@@ -305,6 +707,9 @@ extern "C" {
     void bibtex_analyzer_initialize (BibtexSource * file);
     void bibtex_analyzer_finish     (BibtexSource * file);
 
+    /* move inside a source held in memory */
+    void bibtex_analyzer_seek       (BibtexSource * file, gint offset);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -35,29 +35,102 @@ char program_name [] = "bibtexmodule";
 typedef struct {
   PyObject_HEAD
   BibtexSource *obj;
+  GMutex lock;
+
+  /* an error met after some entries, raised on the next call */
+  PyObject *error_type, *error_value, *error_traceback;
 } PyBibtexSource_Object;
 
 typedef struct {
   PyObject_HEAD
   BibtexField  *obj;
+
+  /* the source whose region holds the field, if any */
+  PyObject     *source;
 } PyBibtexField_Object;
 
 
 /* Destructor of BibtexFile */
 static void bibtex_py_close (PyBibtexSource_Object * self) {
     bibtex_source_destroy (self->obj, TRUE);
+    g_mutex_clear (& self->lock);
+
+    Py_XDECREF (self->error_type);
+    Py_XDECREF (self->error_value);
+    Py_XDECREF (self->error_traceback);
+
     PyObject_DEL (self);
 }
 
+/* 
+   A source is parsed without holding the interpreter lock, so every
+   access to it goes through its own lock. The interpreter lock is
+   released while waiting, as the parsing thread might need it to
+   report an error.
+*/
+static void
+source_lock (PyBibtexSource_Object * self) {
+    if (g_mutex_trylock (& self->lock)) return;
+
+    Py_BEGIN_ALLOW_THREADS
+    g_mutex_lock (& self->lock);
+    Py_END_ALLOW_THREADS
+}
+
+static void
+source_unlock (PyBibtexSource_Object * self) {
+    g_mutex_unlock (& self->lock);
+}
+
+/* 
+   The entries parsed before an error are returned all the same: the
+   error is kept aside, and raised by the next call on the source.
+*/
+static void
+keep_error (PyBibtexSource_Object * self) {
+    PyErr_Fetch (& self->error_type, & self->error_value, 
+		 & self->error_traceback);
+}
+
+static gboolean
+raise_kept_error (PyBibtexSource_Object * self) {
+    if (self->error_type == NULL) return FALSE;
+
+    PyErr_Restore (self->error_type, self->error_value, 
+		   self->error_traceback);
+
+    self->error_type      = NULL;
+    self->error_value     = NULL;
+    self->error_traceback = NULL;
+
+    return TRUE;
+}
+
+/* 
+   The parser stopped before the end of the source: some entries, like
+   a broken @comment, are dropped without a message, but the caller
+   still has to know.
+*/
+static void
+parse_failed (BibtexSource * file) {
+    if (! PyErr_Occurred ()) {
+	PyErr_Format (PyExc_IOError, "%s:%d: can't parse entry",
+		      file->name, file->line);
+    }
+}
+
 /* Destructor of BibtexEntry */
 
 static void destroy_field (PyBibtexField_Object * self)
 {
     bibtex_field_destroy (self->obj, TRUE);
+    Py_XDECREF (self->source);
 
     PyObject_DEL (self);
 }
 
+static PyObject * bib_iternext (PyBibtexSource_Object * file_obj);
+
 static char PyBibtexSource_Type__doc__[] = "This is the type of a BibTeX source";
 static char PyBibtexField_Type__doc__[]  = "This is the type of an internal BibTeX field";
 
@@ -81,8 +154,12 @@ static PyTypeObject PyBibtexSource_Type = {
   (hashfunc)0,                    /*tp_hash*/
   (ternaryfunc)0,                 /*tp_call*/
   (reprfunc)0,                    /*tp_str*/
-  0L,0L,0L,0L,			  /* tp_getattro, tp_setattro, tp_as_buffer, tp_flags */
+  0L,0L,0L,			  /* tp_getattro, tp_setattro, tp_as_buffer */
+  Py_TPFLAGS_DEFAULT,		  /* tp_flags */
   PyBibtexSource_Type__doc__,	  /* tp_doc */
+  0,0,0,0,			  /* tp_traverse, tp_clear, tp_richcompare, tp_weaklistoffset */
+  PyObject_SelfIter,		  /* tp_iter */
+  (iternextfunc)bib_iternext,	  /* tp_iternext */
 };
 
 static PyTypeObject PyBibtexField_Type = {
@@ -117,7 +194,12 @@ py_message_handler (const gchar *log_domain G_GNUC_UNUSED,
 		    const gchar *message,
 		    gpointer user_data G_GNUC_UNUSED)
 {
+    /* we might be called from a parser running without the lock */
+    PyGILState_STATE state = PyGILState_Ensure ();
+
     PyErr_SetString (PyExc_IOError, message);
+
+    PyGILState_Release (state);
 }
 
 static char bib_open_file_doc[] =
@@ -157,6 +239,59 @@ bib_open_file (PyObject * self, PyObject * args)
     if (ret == NULL) return NULL;
 
     ret->obj = file;
+    g_mutex_init (& ret->lock);
+
+    ret->error_type      = NULL;
+    ret->error_value     = NULL;
+    ret->error_traceback = NULL;
+
+    return (PyObject *) ret;
+}
+
+static char bib_open_mmap_doc[] =
+    "open_mmap(filename, strictness) -> BibtexSource object\n\n"
+    "Create an object for the specified filename to parse from, by\n"
+    "mapping the whole file in memory instead of reading it.\n\n"
+    "Args:\n"
+    "    filename (str) -- The BibTex file name\n"
+    "    stricness (boolean) -- Set the parser strict or lousy\n"
+    "Returns:\n"
+    "    A BibtexSource object to start parsing from";
+
+static PyObject *
+bib_open_mmap (PyObject * self, PyObject * args)
+{
+    char * name;
+    BibtexSource * file;
+    gint strictness;
+
+    PyBibtexSource_Object * ret;
+
+    if (! PyArg_ParseTuple(args, "si", & name, & strictness))
+	return NULL;
+
+    file = bibtex_source_new ();
+
+    /* set the strictness */
+    file->strict = strictness;
+
+    if (! bibtex_source_mmap (file, name)) {
+	bibtex_source_destroy (file, TRUE);
+	return NULL;
+    }
+
+    /* Create a new object */
+    ret = (PyBibtexSource_Object *) 
+	PyObject_NEW (PyBibtexSource_Object, & PyBibtexSource_Type);
+    if (ret == NULL) return NULL;
+
+    ret->obj = file;
+    g_mutex_init (& ret->lock);
+
+    ret->error_type      = NULL;
+    ret->error_value     = NULL;
+    ret->error_traceback = NULL;
+
     return (PyObject *) ret;
 }
 
@@ -198,6 +333,12 @@ bib_open_string (PyObject * self, PyObject * args)
     if (ret == NULL) return NULL;
 
     ret->obj = file;
+    g_mutex_init (& ret->lock);
+
+    ret->error_type      = NULL;
+    ret->error_value     = NULL;
+    ret->error_traceback = NULL;
+
     return (PyObject *) ret;
 }
 
@@ -222,18 +363,101 @@ static char bib_expand_doc[] =
     "      Verbatim -> (type, loss, raw_content).\n"
     "      Other -> (type, loss, content)";
 
+/* The authors of a group, as a list of tuples of 4 names */
+static PyObject *
+author_list (BibtexAuthorGroup * group) {
+    PyObject * liste, * auth [4];
+    BibtexAuthor * author, names;
+
+    unsigned int i;
+    int j;
+
+    liste = PyList_New (group->len);
+
+    for (i = 0; i < group->len; i++) {
+	author = bibtex_author_group_get (group, i, & names);
+	if (author->honorific) {
+	  auth [0] = PyUnicode_FromString(author->honorific);
+	}
+	else {
+	    auth [0] = Py_None; 
+	    Py_INCREF (Py_None);
+	}
+
+	if (author->first) {
+	  auth [1] = PyUnicode_FromString(author->first);
+	}
+	else {
+	    auth [1] = Py_None; 
+	    Py_INCREF (Py_None);
+	}
+
+	if (author->last) {
+	  auth [2] = PyUnicode_FromString(author->last);
+	}
+	else {
+	    auth [2] = Py_None; 
+	    Py_INCREF (Py_None);
+	}
+
+	if (author->lineage) {
+	  auth [3] = PyUnicode_FromString(author->lineage);
+	}
+	else {
+	    auth [3] = Py_None; 
+	    Py_INCREF (Py_None);
+	}
+
+	PyList_SetItem (liste, i,
+			Py_BuildValue ("OOOO", 
+				       auth [0],
+				       auth [1],
+				       auth [2],
+				       auth [3]));
+
+	for (j = 0; j < 4; j ++) {
+	    Py_DECREF (auth [j]);
+	}
+    }
+
+    return liste;
+}
+
+/* 
+   Has the text of a lazy field failed to parse ? The error it reported
+   is then raised.
+*/
+static gboolean
+field_failed (BibtexField * field) {
+    if (field->structure || field->raw == NULL) return FALSE;
+
+    if (! PyErr_Occurred ()) {
+	PyErr_SetString (PyExc_IOError, "can't parse field");
+    }
+
+    return TRUE;
+}
+
+/* The structure of a field, or NULL with an error raised */
+static BibtexStruct *
+field_structure (BibtexField * field) {
+    BibtexStruct * s = bibtex_field_get_structure (field);
+
+    if (s == NULL && ! field_failed (field)) {
+	PyErr_SetString (PyExc_IOError, "field has no value");
+    }
+
+    return s;
+}
+
 static PyObject *
 bib_expand (PyObject * self, PyObject * args) {
-    PyObject * liste, * tmp, * auth [4];
+    PyObject * liste, * tmp;
     BibtexFieldType type;
     BibtexField * field;
     BibtexSource * file;
     PyBibtexSource_Object * file_obj;
     PyBibtexField_Object * field_obj;
-    BibtexAuthor * author;
-
-    unsigned int i;
-    int j;
 
     if (! PyArg_ParseTuple(args, "O!O!i:expand", 
 			   &PyBibtexSource_Type, & file_obj, 
@@ -248,10 +472,15 @@ bib_expand (PyObject * self, PyObject * args) {
       if (type != (BibtexFieldType)-1) {
 	    field->type = type;
 	}
-
-	bibtex_field_parse(field, file->table);
     }
+
+    /* converted again if one of its macros has changed meanwhile */
+    source_lock (file_obj);
+    bibtex_field_parse(field, file);
+    source_unlock (file_obj);
     
+    if (field_failed (field)) return NULL;
+
 
     switch (field->type) {
     case BIBTEX_TITLE:
@@ -272,54 +501,8 @@ bib_expand (PyObject * self, PyObject * args) {
 
     case BIBTEX_AUTHOR:
 
-	liste = PyList_New (field->field.author->len);
-
-	for (i = 0; i < field->field.author->len; i++) {
-	    author = & g_array_index (field->field.author, 
-				      BibtexAuthor, i);
-	    if (author->honorific) {
-	      auth [0] = PyUnicode_FromString(author->honorific);
-	    }
-	    else {
-		auth [0] = Py_None; 
-		Py_INCREF (Py_None);
-	    }
-
-	    if (author->first) {
-	      auth [1] = PyUnicode_FromString(author->first);
-	    }
-	    else {
-		auth [1] = Py_None; 
-		Py_INCREF (Py_None);
-	    }
-
-	    if (author->last) {
-	      auth [2] = PyUnicode_FromString(author->last);
-	    }
-	    else {
-		auth [2] = Py_None; 
-		Py_INCREF (Py_None);
-	    }
-
-	    if (author->lineage) {
-	      auth [3] = PyUnicode_FromString(author->lineage);
-	    }
-	    else {
-		auth [3] = Py_None; 
-		Py_INCREF (Py_None);
-	    }
-
-	    PyList_SetItem (liste, i,
-			    Py_BuildValue ("OOOO", 
-					   auth [0],
-					   auth [1],
-					   auth [2],
-					   auth [3]));
+	liste = author_list (field->field.author);
 
-	    for (j = 0; j < 4; j ++) {
-		Py_DECREF (auth [j]);
-	    }
-	}
 	tmp = Py_BuildValue ("iisO", 
 			     field->type, 
 			     field->loss, 
@@ -335,6 +518,61 @@ bib_expand (PyObject * self, PyObject * args) {
     return tmp;
 }
 
+static char bib_get_authors_doc[] =
+    "get_authors(source, field, count) -> Tuple\n\n"
+    "Get the first authors of a field, without building the others.\n\n"
+    "Args:\n"
+    "    source (BibtexSource) -- A Bibtex source object (parser).\n"
+    "    field (BibtexField) -- A field holding a list of authors.\n"
+    "    count (int) -- How many authors to build, 0 for all of them.\n"
+    "Returns:\n"
+    "    A tuple (total, [(honorific, first, last, lineage),...]) with the\n"
+    "    number of authors of the whole field.";
+
+static PyObject *
+bib_get_authors (PyObject * self, PyObject * args) {
+    PyObject * liste, * tmp;
+    BibtexField * field;
+    BibtexStruct * s;
+    BibtexAuthorGroup * group = NULL;
+    PyBibtexSource_Object * file_obj;
+    PyBibtexField_Object * field_obj;
+
+    guint count, total = 0;
+
+    if (! PyArg_ParseTuple(args, "O!O!I:get_authors", 
+			   &PyBibtexSource_Type, & file_obj, 
+			   &PyBibtexField_Type, & field_obj, 
+			   & count))
+	return NULL;
+
+    field = field_obj->obj;
+
+    source_lock (file_obj);
+
+    s = bibtex_field_get_structure (field);
+
+    if (s) {
+	group = bibtex_author_parse_n (s, file_obj->obj, count, & total);
+    }
+
+    source_unlock (file_obj);
+
+    if (field_failed (field)) return NULL;
+
+    if (group == NULL) {
+	return Py_BuildValue ("i[]", 0);
+    }
+
+    liste = author_list (group);
+    bibtex_author_group_destroy (group);
+
+    tmp = Py_BuildValue ("IO", total, liste);
+    Py_DECREF (liste);
+
+    return tmp;
+}
+
 static char bib_get_native_doc[] =
     "get_native(field) -> str\n\n"
     "Get the native BibTex content of `field`.\n\n"
@@ -343,28 +581,50 @@ static char bib_get_native_doc[] =
     "Returns:\n"
     "    A string with a native BibTex conversion of `field`.";
 
+static void
+free_buffer (gpointer buffer) {
+    g_string_free ((GString *) buffer, TRUE);
+}
+
+/* Fields are rendered in a buffer kept by each thread */
+static GPrivate render_buffer = G_PRIVATE_INIT (free_buffer);
+
+static GString *
+get_render_buffer (void) {
+    GString * buffer = g_private_get (& render_buffer);
+
+    if (buffer == NULL) {
+	buffer = g_string_sized_new (256);
+	g_private_set (& render_buffer, buffer);
+    }
+
+    g_string_truncate (buffer, 0);
+
+    return buffer;
+}
+
 static PyObject *
 bib_get_native (PyObject * self, PyObject * args) {
-    PyObject * tmp;
     BibtexField * field;
     PyBibtexField_Object * field_obj;
-    gchar * text;
+    GString * buffer;
 
     if (! PyArg_ParseTuple(args, "O!:get_native", & PyBibtexField_Type, & field_obj))
 	return NULL;
 
     field = field_obj->obj;
 
-    if (field->structure == NULL) {
+    if (bibtex_field_get_structure (field) == NULL) {
+      if (field_failed (field)) return NULL;
+
       Py_INCREF (Py_None);
       return Py_None;
     }
 
-    text = bibtex_struct_as_bibtex (field->structure);
-    tmp = Py_BuildValue("s", text); 
-    g_free (text);
+    buffer = get_render_buffer ();
+    bibtex_struct_write_bibtex (field->structure, buffer);
 
-    return tmp;
+    return Py_BuildValue("s", buffer->str);
 }
 
 static char bib_copy_field_doc[] =
@@ -378,6 +638,7 @@ static char bib_copy_field_doc[] =
 static PyObject *
 bib_copy_field (PyObject * self, PyObject * args) {
     BibtexField * field;
+    BibtexStruct * s;
     PyBibtexField_Object * field_obj, * new_obj;
 
     if (! PyArg_ParseTuple(args, "O!:get_native", & PyBibtexField_Type, & field_obj))
@@ -385,11 +646,15 @@ bib_copy_field (PyObject * self, PyObject * args) {
 
     field = field_obj->obj;
 
+    s = field_structure (field);
+    if (s == NULL) return NULL;
+
     new_obj = (PyBibtexField_Object *) 
 	PyObject_NEW(PyBibtexField_Object, & PyBibtexField_Type);
     if (new_obj == NULL) return NULL;
 
-    new_obj->obj = bibtex_struct_as_field (bibtex_struct_copy (field->structure), field->type);
+    new_obj->obj = bibtex_struct_as_field (bibtex_struct_copy (s), field->type);
+    new_obj->source = NULL;
     return (PyObject *) new_obj;
 }
 
@@ -403,13 +668,13 @@ static char bib_get_latex_doc[] =
 
 static PyObject *
 bib_get_latex (PyObject * self, PyObject * args) {
-    PyObject * tmp;
     BibtexField * field;
     PyBibtexField_Object * field_obj;
     BibtexFieldType type;
     BibtexSource * file;
+    BibtexStruct * s;
     PyBibtexSource_Object * file_obj;
-    gchar * text;
+    GString * buffer;
 
     if (! PyArg_ParseTuple(args, "O!O!i:get_latex", 
 			   &PyBibtexSource_Type, & file_obj, 
@@ -421,12 +686,21 @@ bib_get_latex (PyObject * self, PyObject * args) {
     field = field_obj->obj;
     file  = file_obj->obj;
 
-    text = bibtex_struct_as_latex (field->structure,
-				   type, file->table);
-    tmp = Py_BuildValue("s", text); 
-    g_free (text);
+    buffer = get_render_buffer ();
 
-    return tmp;
+    source_lock (file_obj);
+
+    s = field_structure (field);
+
+    if (s) {
+	bibtex_struct_write_latex (s, buffer, type, file);
+    }
+
+    source_unlock (file_obj);
+
+    if (s == NULL) return NULL;
+
+    return Py_BuildValue("s", buffer->str);
 }
 
 static char bib_set_native_doc[] =
@@ -442,63 +716,59 @@ static PyObject *
 bib_set_native (PyObject * self, PyObject * args) {
     PyObject * tmp;
     BibtexField * field;
-    static BibtexSource * source = NULL;
-    BibtexEntry * entry;
     BibtexStruct * s;
     BibtexFieldType type;
 
-    gchar * text, * to_parse;
+    gchar * text;
 
     if (! PyArg_ParseTuple(args, "si:set_native", & text, &type))
 	return NULL;
 
-    /* Create new source */
-    if (source == NULL) source = bibtex_source_new ();
-
     /* parse as a string */
-    to_parse = g_strdup_printf ("@preamble{%s}", text);
-
-    if (! bibtex_source_string (source, "internal string", to_parse)) {
-	PyErr_SetString (PyExc_IOError, 
-			 "can't create internal string for parsing");
-	return NULL;
-    }
-
-    g_free (to_parse);
+    s = bibtex_struct_parse (text, -1);
 
-    entry = bibtex_source_next_entry (source, FALSE);
-
-    if (entry == NULL) {
+    if (s == NULL) {
 	return NULL;
     }
 
-    s = bibtex_struct_copy (entry->preamble);
-    bibtex_entry_destroy (entry, TRUE);
-
     field = bibtex_struct_as_field (s, type);
 
     tmp = (PyObject *) PyObject_NEW (PyBibtexField_Object, & PyBibtexField_Type);
     if (tmp == NULL) return NULL;
 
     ((PyBibtexField_Object *) tmp)->obj = field;
+    ((PyBibtexField_Object *) tmp)->source = NULL;
     return tmp;
 }
 
 
+typedef struct {
+    PyObject * dico;
+    PyObject * source;
+} FillContext;
+
 static void 
-fill_dico (gpointer key, gpointer value, gpointer user)
+fill_dico (GQuark name, BibtexField * field, FillContext * context)
 {
-    PyObject * dico = (PyObject *) user;
     PyObject * tmp1, * tmp2;
 
-    tmp1 = PyUnicode_FromString ((char *) key);
+    tmp1 = PyUnicode_FromString (g_quark_to_string (name));
     tmp2 = (PyObject *) PyObject_NEW (PyBibtexField_Object, & PyBibtexField_Type);
     /* this only happens when OOM'ing, not much to salvage except not crashing */
     if (tmp1 == NULL || tmp2 == NULL) return;
     
-    ((PyBibtexField_Object *) tmp2)->obj = value;
+    ((PyBibtexField_Object *) tmp2)->obj = field;
 
-    PyDict_SetItem (dico, tmp1, tmp2);
+    /* a field in a region, or lazy, must not outlive its source */
+    if (field->in_region || field->raw) {
+	Py_INCREF (context->source);
+	((PyBibtexField_Object *) tmp2)->source = context->source;
+    }
+    else {
+	((PyBibtexField_Object *) tmp2)->source = NULL;
+    }
+
+    PyDict_SetItem (context->dico, tmp1, tmp2);
 
     Py_DECREF (tmp1);
     Py_DECREF (tmp2);
@@ -517,6 +787,7 @@ fill_struct_dico (gpointer key, gpointer value, gpointer user)
 
     ((PyBibtexField_Object *) tmp2)->obj = bibtex_struct_as_field
 	(bibtex_struct_copy ((BibtexStruct *) value), BIBTEX_OTHER);
+    ((PyBibtexField_Object *) tmp2)->source = NULL;
 
     PyDict_SetItem (dico, tmp1, tmp2);
 
@@ -537,6 +808,7 @@ bib_set_string (PyObject * self, PyObject * args)
 {
     BibtexField * field;
     BibtexSource * source;
+    BibtexStruct * s;
     PyBibtexSource_Object * source_obj;
     PyBibtexField_Object * field_obj;
     
@@ -555,49 +827,51 @@ bib_set_string (PyObject * self, PyObject * args)
     field  = field_obj->obj;
 
     /* set a copy of the struct as the field value */
-    bibtex_source_set_string (source, key, 
-			      bibtex_struct_copy (field->structure));
+    source_lock (source_obj);
+
+    s = field_structure (field);
+
+    if (s) {
+	bibtex_source_set_string (source, key, bibtex_struct_copy (s));
+    }
+
+    source_unlock (source_obj);
+
+    if (s == NULL) return NULL;
 
     Py_INCREF (Py_None);
     return Py_None;
 }
 
 
+/* Convert an entry into its python tuple, and free it */
 static PyObject *
-_bib_next (PyBibtexSource_Object * file_obj, gboolean filter)
+entry_tuple (PyBibtexSource_Object * file_obj, BibtexEntry * ent, 
+	     gboolean filter)
 {
-    BibtexEntry * ent;
-    BibtexSource * file;
-
     PyObject * dico, * tmp, * name;
+    FillContext context;
+    guint i;
 
-    file = file_obj->obj;
-
-    ent = bibtex_source_next_entry (file, filter);
-
-    if (ent == NULL) {
-	if (file->eof) {
-	    Py_INCREF(Py_None);
-	    return Py_None;
-	}
-
-	return NULL;
-    }
-
-    /* Retour de la fonction */
     if (! filter && ! ent->name) {
 	if (ent->textual_preamble) {
-	    tmp = Py_BuildValue ("ss", ent->type, ent->textual_preamble);
+	    tmp = Py_BuildValue ("ss", g_quark_to_string (ent->type), 
+				 ent->textual_preamble);
 	}
 	else {
 	    /* this must be a string then... */
-	    tmp = Py_BuildValue ("(s)", ent->type);
+	    tmp = Py_BuildValue ("(s)", g_quark_to_string (ent->type));
 	}
     }
     else {
 	dico = PyDict_New (); 
+
+	context.dico   = dico;
+	context.source = (PyObject *) file_obj;
 	
-	g_hash_table_foreach (ent->table, fill_dico, dico);
+	for (i = 0; i < ent->n_fields; i ++) {
+	    fill_dico (ent->fields [i].name, ent->fields [i].field, & context);
+	}
 	
 	if (ent->name) {
 	    name = PyUnicode_FromString (ent->name);
@@ -608,13 +882,13 @@ _bib_next (PyBibtexSource_Object * file_obj, gboolean filter)
 	}
 	
 	if (filter) {
-	    tmp = Py_BuildValue ("NsiiO", name, ent->type, 
+	    tmp = Py_BuildValue ("NsiiO", name, g_quark_to_string (ent->type), 
 				 ent->offset, ent->start_line,
 				 dico);
 	}
 	else {
 	    tmp = Py_BuildValue ("(s(NsiiO))", "entry", name, 
-				 ent->type, 
+				 g_quark_to_string (ent->type), 
 				 ent->offset, ent->start_line,
 				 dico);
 	}
@@ -627,6 +901,39 @@ _bib_next (PyBibtexSource_Object * file_obj, gboolean filter)
     return tmp;
 }
 
+static PyObject *
+_bib_next (PyBibtexSource_Object * file_obj, gboolean filter)
+{
+    BibtexEntry * ent;
+    BibtexSource * file;
+
+    file = file_obj->obj;
+
+    if (raise_kept_error (file_obj)) return NULL;
+
+    source_lock (file_obj);
+
+    /* other threads can run while we parse */
+    Py_BEGIN_ALLOW_THREADS
+    ent = bibtex_source_next_entry (file, filter);
+    Py_END_ALLOW_THREADS
+
+    source_unlock (file_obj);
+
+    if (ent == NULL) {
+	if (file->eof) {
+	    Py_INCREF(Py_None);
+	    return Py_None;
+	}
+
+	parse_failed (file);
+	return NULL;
+    }
+
+    /* Retour de la fonction */
+    return entry_tuple (file_obj, ent, filter);
+}
+
 static char bib_next_doc[] =
     "next(source) -> Tuple\n\n"
     "Get the next BibTex entry from `source`.\n\n"
@@ -647,7 +954,106 @@ bib_next (PyObject * self, PyObject * args)
     return _bib_next (file_obj, TRUE);
 }
 
-static char bib_next_unfiltered_doc[] =
+/* Convert the entries of the array, and free it */
+static PyObject *
+entry_list (PyBibtexSource_Object * file_obj, GPtrArray * entries)
+{
+    PyObject * list, * tmp;
+    guint i;
+
+    list = PyList_New (0);
+
+    for (i = 0; i < entries->len; i ++) {
+	tmp = entry_tuple (file_obj, g_ptr_array_index (entries, i), TRUE);
+
+	if (list && tmp) {
+	    PyList_Append (list, tmp);
+	}
+
+	Py_XDECREF (tmp);
+    }
+
+    g_ptr_array_free (entries, TRUE);
+
+    return list;
+}
+
+static char bib_next_many_doc[] =
+    "next_many(source, n) -> List\n\n"
+    "Get up to `n` of the next BibTex entries from `source` at once.\n"
+    "On an error, the entries before it are returned, and the error\n"
+    "is raised by the next call on `source`.\n\n"
+    "Args:\n"
+    "    source (BibtexSource) -- A Bibtex source object (parser).\n"
+    "    n (int) -- Maximum number of entries.\n"
+    "Returns:\n"
+    "    A list of tuples (key, field_type, offset, line, object), which\n"
+    "    is empty at the end of the source.\n";
+
+static PyObject *
+bib_next_many (PyObject * self, PyObject * args)
+{
+    PyBibtexSource_Object * file_obj;
+    BibtexSource * file;
+    BibtexEntry * ent;
+    GPtrArray * entries;
+    gboolean ok;
+    gint n;
+
+    if (! PyArg_ParseTuple(args, "O!i:next_many", & PyBibtexSource_Type, 
+			   & file_obj, & n))
+	return NULL;
+
+    file = file_obj->obj;
+
+    if (raise_kept_error (file_obj)) return NULL;
+
+    entries = g_ptr_array_new ();
+
+    source_lock (file_obj);
+
+    /* parse the whole batch without going back to python */
+    Py_BEGIN_ALLOW_THREADS
+    while (entries->len < (guint) MAX (n, 0) &&
+	   (ent = bibtex_source_next_entry (file, TRUE)) != NULL) {
+	g_ptr_array_add (entries, ent);
+    }
+    ok = (entries->len == (guint) MAX (n, 0) || file->eof);
+    Py_END_ALLOW_THREADS
+
+    source_unlock (file_obj);
+
+    if (! ok) {
+	parse_failed (file);
+
+	if (entries->len == 0) {
+	    g_ptr_array_free (entries, TRUE);
+	    return NULL;
+	}
+
+	keep_error (file_obj);
+    }
+
+    return entry_list (file_obj, entries);
+}
+
+/* iterating over a source gives its entries, as next does */
+static PyObject *
+bib_iternext (PyBibtexSource_Object * file_obj)
+{
+    PyObject * tmp;
+
+    tmp = _bib_next (file_obj, TRUE);
+
+    if (tmp == Py_None) {
+	Py_DECREF (tmp);
+	return NULL;
+    }
+
+    return tmp;
+}
+
+static char bib_next_unfiltered_doc[] =
     "next_unfiltered(source) -> Tuple\n\n"
     "Get the next BibTex entry from `source`.\n\n"
     "Args:\n"
@@ -666,6 +1072,489 @@ bib_next_unfiltered (PyObject * self, PyObject * args)
     return _bib_next (file_obj, FALSE);
 }
 
+static char bib_parse_all_doc[] =
+    "parse_all(source, threads) -> List\n\n"
+    "Get all the remaining BibTex entries from `source`. Sources read\n"
+    "from memory are parsed by several threads at once. The parsing\n"
+    "stops on the first error: the entries before it are returned,\n"
+    "and the error is raised by the next call on `source`.\n\n"
+    "Args:\n"
+    "    source (BibtexSource) -- A Bibtex source object (parser).\n"
+    "    threads (int) -- Number of threads, 0 for one per processor.\n"
+    "Returns:\n"
+    "    A list of tuples (key, field_type, offset, line, object)\n";
+
+static PyObject *
+bib_parse_all (PyObject * self, PyObject * args)
+{
+    PyBibtexSource_Object * file_obj;
+    BibtexSource * file;
+    GPtrArray * entries;
+    gint threads;
+
+    if (! PyArg_ParseTuple(args, "O!i:parse_all", & PyBibtexSource_Type, 
+			   & file_obj, & threads))
+	return NULL;
+
+    file = file_obj->obj;
+
+    if (raise_kept_error (file_obj)) return NULL;
+
+    source_lock (file_obj);
+
+    Py_BEGIN_ALLOW_THREADS
+    entries = bibtex_source_parse_all (file, TRUE, threads);
+    Py_END_ALLOW_THREADS
+
+    source_unlock (file_obj);
+
+    if (! file->eof) {
+	parse_failed (file);
+
+	if (entries->len == 0) {
+	    g_ptr_array_free (entries, TRUE);
+	    return NULL;
+	}
+
+	keep_error (file_obj);
+    }
+
+    return entry_list (file_obj, entries);
+}
+
+/* Turn the current exception into a warning */
+static gboolean
+warn_error (void) {
+    PyObject * type, * value, * traceback, * text;
+    const char * message = NULL;
+    int status = -1;
+
+    PyErr_Fetch (& type, & value, & traceback);
+
+    text = PyObject_Str (value ? value : type);
+    if (text) {
+	message = PyUnicode_AsUTF8 (text);
+    }
+    if (message) {
+	status = PyErr_WarnEx (PyExc_RuntimeWarning, message, 1);
+    }
+    Py_XDECREF (text);
+
+    Py_XDECREF (type);
+    Py_XDECREF (value);
+    Py_XDECREF (traceback);
+
+    return status == 0;
+}
+
+static char bib_load_all_doc[] =
+    "load_all(filename, strictness) -> List\n\n"
+    "Parse a whole BibTex file at once, with one thread per processor.\n"
+    "Each faulty entry is skipped with a RuntimeWarning, and the\n"
+    "parsing goes on after it.\n\n"
+    "Args:\n"
+    "    filename (str) -- The BibTex file name\n"
+    "    stricness (boolean) -- Set the parser strict or lousy\n"
+    "Returns:\n"
+    "    A list of tuples (key, field_type, offset, line, object)\n";
+
+static PyObject *
+bib_load_all (PyObject * self, PyObject * args)
+{
+    char * name;
+    BibtexSource * file;
+    GPtrArray * entries, * all;
+    gint strictness, offset;
+    guint i;
+
+    PyBibtexSource_Object * file_obj;
+    PyObject * list;
+
+    if (! PyArg_ParseTuple(args, "si:load_all", & name, & strictness))
+	return NULL;
+
+    file = bibtex_source_new ();
+
+    /* set the strictness */
+    file->strict = strictness;
+
+    if (! bibtex_source_mmap (file, name)) {
+	bibtex_source_destroy (file, TRUE);
+	return NULL;
+    }
+
+    file_obj = (PyBibtexSource_Object *) 
+	PyObject_NEW (PyBibtexSource_Object, & PyBibtexSource_Type);
+    if (file_obj == NULL) {
+	bibtex_source_destroy (file, TRUE);
+	return NULL;
+    }
+
+    file_obj->obj = file;
+    g_mutex_init (& file_obj->lock);
+
+    file_obj->error_type      = NULL;
+    file_obj->error_value     = NULL;
+    file_obj->error_traceback = NULL;
+
+    all = g_ptr_array_new ();
+
+    for (;;) {
+	offset = bibtex_source_get_offset (file);
+
+	/* nobody else knows about the source yet */
+	Py_BEGIN_ALLOW_THREADS
+	entries = bibtex_source_parse_all (file, TRUE, 0);
+	Py_END_ALLOW_THREADS
+
+	for (i = 0; i < entries->len; i ++) {
+	    g_ptr_array_add (all, g_ptr_array_index (entries, i));
+	}
+	g_ptr_array_free (entries, TRUE);
+
+	if (file->eof) break;
+
+	/* the source is left after the faulty entry */
+	parse_failed (file);
+
+	if (! warn_error ()) {
+	    for (i = 0; i < all->len; i ++) {
+		bibtex_entry_destroy (g_ptr_array_index (all, i), TRUE);
+	    }
+	    g_ptr_array_free (all, TRUE);
+
+	    Py_DECREF (file_obj);
+	    return NULL;
+	}
+
+	if (bibtex_source_get_offset (file) == offset) break;
+    }
+
+    list = entry_list (file_obj, all);
+
+    /* the fields that still need the source hold it */
+    Py_DECREF (file_obj);
+
+    return list;
+}
+
+/* Append an entry given as (type, key, fields) to out */
+static gboolean
+write_entry (PyObject * item, GString * out)
+{
+    PyObject * fields, * pair;
+    PyBibtexField_Object * field_obj;
+    char * type, * key, * name;
+    Py_ssize_t i, length;
+
+    if (! PyArg_ParseTuple (item, "ssO:write", & type, & key, & fields))
+	return FALSE;
+
+    fields = PySequence_Fast (fields, "fields must be a sequence of pairs");
+    if (fields == NULL) return FALSE;
+
+    g_string_append_printf (out, "@%s{%s,\n", type, key);
+
+    length = PySequence_Fast_GET_SIZE (fields);
+
+    for (i = 0; i < length; i ++) {
+	pair = PySequence_Fast_GET_ITEM (fields, i);
+
+	if (! PyArg_ParseTuple (pair, "sO!:write", & name, 
+				& PyBibtexField_Type, & field_obj)) {
+	    Py_DECREF (fields);
+	    return FALSE;
+	}
+
+	g_string_append_printf (out, "  %s = ", name);
+	bibtex_field_write (field_obj->obj, out);
+	g_string_append (out, ",\n");
+    }
+
+    g_string_append_c (out, '}');
+
+    Py_DECREF (fields);
+    return TRUE;
+}
+
+/* 
+   A part of the output: some of the text of the source, when length
+   is not 0, followed by the bytes from start to end of the new text.
+*/
+typedef struct {
+    gint offset, length;
+    gsize start, end;
+} WritePart;
+
+/* Write out all the parts, without the interpreter lock */
+static gboolean
+write_parts (BibtexSource * file, int fd, GString * text, GArray * parts)
+{
+    WritePart * part;
+    gboolean ok = TRUE;
+    guint i;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    for (i = 0; ok && i < parts->len; i ++) {
+	part = & g_array_index (parts, WritePart, i);
+
+	if (part->length != 0) {
+	    ok = bibtex_source_copy (file, part->offset, part->length, fd);
+	}
+
+	if (ok && part->end > part->start) {
+	    ok = bibtex_write_text (fd, text->str + part->start,
+				    part->end - part->start);
+	}
+    }
+
+    Py_END_ALLOW_THREADS
+
+    return ok;
+}
+
+static char bib_write_doc[] =
+    "write(source, file, items)\n\n"
+    "Write a database, where unmodified entries are copied from the\n"
+    "text of their source as they are.\n\n"
+    "Args:\n"
+    "    source (BibtexSource) -- The source the entries were read from.\n"
+    "    file (int or file) -- Where to write, as a descriptor or a file.\n"
+    "    items (sequence) -- In order, any of:\n"
+    "        (offset, length): that part of the text of `source`, a\n"
+    "            negative length going up to its end;\n"
+    "        (type, key, fields): an entry, written with a sequence of\n"
+    "            (name, BibtexField) pairs, after an empty line;\n"
+    "        a string: written as it is.";
+
+static PyObject *
+bib_write (PyObject * self, PyObject * args)
+{
+    PyBibtexSource_Object * file_obj;
+    PyObject * target, * sequence, * items, * item, * tmp;
+    GString * text;
+    GArray * parts;
+    WritePart part, * last;
+    gint o, l;
+    gboolean ok = TRUE;
+    const char * string;
+    Py_ssize_t n, i, size;
+    int fd;
+
+    if (! PyArg_ParseTuple(args, "O!OO:write", & PyBibtexSource_Type, 
+			   & file_obj, & target, & sequence))
+	return NULL;
+
+    fd = PyObject_AsFileDescriptor (target);
+    if (fd == -1) return NULL;
+
+    items = PySequence_Fast (sequence, "items must be a sequence");
+    if (items == NULL) return NULL;
+
+    /* python files keep some of their output to themselves */
+    if (PyObject_HasAttrString (target, "flush")) {
+	tmp = PyObject_CallMethod (target, "flush", NULL);
+	if (tmp == NULL) {
+	    Py_DECREF (items);
+	    return NULL;
+	}
+	Py_DECREF (tmp);
+    }
+
+    text  = g_string_sized_new (4096);
+    parts = g_array_new (FALSE, FALSE, sizeof (WritePart));
+    n     = PySequence_Fast_GET_SIZE (items);
+
+    /* 
+       Everything that needs python is done first: the source is then
+       only locked while it is written, as a __str__ might use it.
+    */
+    for (i = 0; ok && i < n; i ++) {
+	item = PySequence_Fast_GET_ITEM (items, i);
+	last = parts->len ? 
+	    & g_array_index (parts, WritePart, parts->len - 1) : NULL;
+
+	if (PyTuple_Check (item) && PyTuple_GET_SIZE (item) == 2) {
+	    if (! PyArg_ParseTuple (item, "ii:write", & o, & l)) {
+		ok = FALSE;
+		break;
+	    }
+
+	    /* follows the previous part: copied along */
+	    if (last && last->length > 0 && last->end == last->start &&
+		o == last->offset + last->length) {
+		last->length = (l < 0) ? -1 : last->length + l;
+		continue;
+	    }
+
+	    part.offset = o;
+	    part.length = l;
+	    part.start  = part.end = text->len;
+
+	    g_array_append_val (parts, part);
+	    continue;
+	}
+
+	if (last == NULL) {
+	    part.offset = part.length = 0;
+	    part.start  = part.end = text->len;
+
+	    g_array_append_val (parts, part);
+	}
+
+	if (PyTuple_Check (item)) {
+	    if (i > 0) g_string_append (text, "\n\n");
+
+	    ok = write_entry (item, text);
+	}
+	else {
+	    tmp = PyObject_Str (item);
+
+	    if (tmp == NULL) {
+		ok = FALSE;
+		break;
+	    }
+
+	    string = PyUnicode_AsUTF8AndSize (tmp, & size);
+	    if (string) {
+		g_string_append_len (text, string, size);
+	    }
+	    else {
+		ok = FALSE;
+	    }
+
+	    Py_DECREF (tmp);
+	}
+
+	g_array_index (parts, WritePart, parts->len - 1).end = text->len;
+    }
+
+    if (ok) {
+	source_lock (file_obj);
+	ok = write_parts (file_obj->obj, fd, text, parts);
+	source_unlock (file_obj);
+    }
+
+    g_string_free (text, TRUE);
+    g_array_free (parts, TRUE);
+    Py_DECREF (items);
+
+    if (! ok) {
+	if (! PyErr_Occurred ()) {
+	    PyErr_SetString (PyExc_IOError, "can't write");
+	}
+	return NULL;
+    }
+
+    Py_INCREF (Py_None);
+    return Py_None;
+}
+
+static char bib_patch_doc[] =
+    "patch(source, offset, length, text) -> int\n\n"
+    "Replace a part of the file of `source`, like an entry, with\n"
+    "`text`. The file is written in place when `text` fits, the space\n"
+    "left being filled with blanks; otherwise only what follows moves.\n"
+    "The entries read after that part are not read again.\n\n"
+    "Args:\n"
+    "    source (BibtexSource) -- A source read from a file.\n"
+    "    offset (int) -- Where the part starts, as given by next.\n"
+    "    length (int) -- Its length, up to the offset of the next entry.\n"
+    "    text (str) -- The new text.\n"
+    "Returns:\n"
+    "    How far the entries after that part have moved.";
+
+static PyObject *
+bib_patch (PyObject * self, PyObject * args)
+{
+    PyBibtexSource_Object * file_obj;
+    PyObject * tmp;
+    gint offset, length, shift = 0;
+    gboolean ok;
+    const char * text;
+    Py_ssize_t size;
+
+    if (! PyArg_ParseTuple(args, "O!iiO:patch", & PyBibtexSource_Type, 
+			   & file_obj, & offset, & length, & tmp))
+	return NULL;
+
+    tmp = PyObject_Str (tmp);
+    if (tmp == NULL) return NULL;
+
+    /* the text belongs to tmp, which is kept until it is written */
+    text = PyUnicode_AsUTF8AndSize (tmp, & size);
+    if (text == NULL) {
+	Py_DECREF (tmp);
+	return NULL;
+    }
+
+    source_lock (file_obj);
+
+    Py_BEGIN_ALLOW_THREADS
+    ok = bibtex_source_patch (file_obj->obj, offset, length, 
+			      text, size, & shift);
+    Py_END_ALLOW_THREADS
+
+    source_unlock (file_obj);
+
+    Py_DECREF (tmp);
+
+    if (! ok) return NULL;
+
+    return PyLong_FromLong ((long) shift);
+}
+
+static char bib_use_region_doc[] =
+    "use_region(source)\n\n"
+    "Allocate the entries parsed from now on in bulk, with `source`.\n"
+    "Their fields keep `source` alive as long as they are used.\n\n"
+    "Args:\n"
+    "    source (BibtexSource) -- A Bibtex source object (parser).";
+
+static PyObject *
+bib_use_region (PyObject * self, PyObject * args)
+{
+    PyBibtexSource_Object * file_obj;
+
+    if (! PyArg_ParseTuple(args, "O!:use_region", & PyBibtexSource_Type, 
+			   & file_obj))
+	return NULL;
+
+    source_lock (file_obj);
+    bibtex_source_use_region (file_obj->obj);
+    source_unlock (file_obj);
+
+    Py_INCREF (Py_None);
+    return Py_None;
+}
+
+static char bib_set_lazy_doc[] =
+    "set_lazy(source, lazy)\n\n"
+    "Only keep the text of the fields read from now on, and parse it\n"
+    "when it is first used. Sources read through stdio ignore it.\n\n"
+    "Args:\n"
+    "    source (BibtexSource) -- A Bibtex source object (parser).\n"
+    "    lazy (int) -- True to parse the fields lazily.";
+
+static PyObject *
+bib_set_lazy (PyObject * self, PyObject * args)
+{
+    PyBibtexSource_Object * file_obj;
+    gint lazy;
+
+    if (! PyArg_ParseTuple(args, "O!i:set_lazy", & PyBibtexSource_Type, 
+			   & file_obj, & lazy))
+	return NULL;
+
+    source_lock (file_obj);
+    file_obj->obj->lazy = lazy;
+    source_unlock (file_obj);
+
+    Py_INCREF (Py_None);
+    return Py_None;
+}
+
 static char bib_get_dict_doc[] =
     "get_dict(source) -> Dict\n\n"
     "Get a dictionaty of entries from `source`.\n\n"
@@ -688,7 +1577,10 @@ bib_get_dict (PyObject * self, PyObject * args)
     file = file_obj->obj;
 
     dico = PyDict_New (); 
-    g_hash_table_foreach (file->table, fill_struct_dico, dico);
+
+    source_lock (file_obj);
+    bibtex_dict_foreach (file->table, fill_struct_dico, dico);
+    source_unlock (file_obj);
 
     return dico;
 }
@@ -710,27 +1602,27 @@ bib_first (PyObject * self, PyObject * args)
 
     file = file_obj->obj;
 
+    source_lock (file_obj);
     bibtex_source_rewind (file);
+    source_unlock (file_obj);
 
     Py_INCREF(Py_None);
     return Py_None;
 }
 
-static char bib_reverse_doc[] =
-    "reverse(field_type, use_braces, content) -> BibtexField\n\n";
-
-static PyObject *
-bib_reverse (PyObject * self, PyObject * args)
+/* 
+   A new field of the given type, holding the python value: a text, a
+   date or a sequence of authors. Returns NULL on error.
+*/
+static BibtexField *
+field_from_native (BibtexFieldType type, PyObject * tuple)
 {
     BibtexField * field;
-    PyObject * tuple, * authobj, * tmp;
-    BibtexFieldType type;
-    BibtexAuthor * auth;
+    PyObject * authobj, * tmp;
+    PyObject * attr [4];
+    BibtexAuthor auth;
 
-    gint length, i, brace, quote;
-
-    if (! PyArg_ParseTuple(args, "iiO:reverse", & type, & brace, & tuple))
-	return NULL;
+    gint length, i, j;
 
     field = bibtex_field_new (type);
 
@@ -739,16 +1631,12 @@ bib_reverse (PyObject * self, PyObject * args)
 	return NULL;
     }
 
-    quote = 1;
-
     switch (field->type) {
     case BIBTEX_VERBATIM:
-	quote = 0;
-
     case BIBTEX_OTHER:
     case BIBTEX_TITLE:
 	tmp = PyObject_Str (tuple);
-	if (tmp == NULL) return NULL;
+	if (tmp == NULL) goto error;
 
 	field->text = g_strdup (PyUnicode_AsUTF8 (tmp));
 	Py_DECREF (tmp);
@@ -756,21 +1644,21 @@ bib_reverse (PyObject * self, PyObject * args)
 
     case BIBTEX_DATE:
 	tmp = PyObject_GetAttrString (tuple, "year");
-	if (tmp == NULL) return NULL;
+	if (tmp == NULL) goto error;
 
 	if (tmp != Py_None)
 	    field->field.date.year  = PyLong_AsLong (tmp);
 	Py_DECREF (tmp);
 
 	tmp = PyObject_GetAttrString (tuple, "month");
-	if (tmp == NULL) return NULL;
+	if (tmp == NULL) goto error;
 
 	if (tmp != Py_None)
 	    field->field.date.month = PyLong_AsLong (tmp);
 	Py_DECREF (tmp);
 
 	tmp = PyObject_GetAttrString (tuple, "day");
-	if (tmp == NULL) return NULL;
+	if (tmp == NULL) goto error;
 
 	if (tmp != Py_None)
 	    field->field.date.day   = PyLong_AsLong (tmp);
@@ -780,62 +1668,158 @@ bib_reverse (PyObject * self, PyObject * args)
     case BIBTEX_AUTHOR:
 	length = PySequence_Length (tuple);
 
-	if (length < 0) return NULL;
+	if (length < 0) goto error;
 
 	field->field.author = bibtex_author_group_new ();
 
-	g_array_set_size (field->field.author, length);
-
 	for (i = 0; i < length; i++) {
 	    authobj = PySequence_GetItem (tuple, i);
-	    auth    = & g_array_index (field->field.author, BibtexAuthor, i);
-	    
-	    tmp = PyObject_GetAttrString (authobj, "last");
-	    if (tmp != Py_None) {
-		auth->last = g_strdup (PyUnicode_AsUTF8 (tmp));
-	    }
-	    else {
-		auth->last = NULL;
-	    }
-	    Py_DECREF (tmp);
-	    tmp = PyObject_GetAttrString (authobj, "first");
-	    if (tmp != Py_None) {
-		auth->first = g_strdup (PyUnicode_AsUTF8 (tmp));
-	    }
-	    else {
-		auth->first = NULL;
-	    }
-	    Py_DECREF (tmp);
-	    tmp = PyObject_GetAttrString (authobj, "lineage");
-	    if (tmp != Py_None) {
-		auth->lineage = g_strdup (PyUnicode_AsUTF8 (tmp));
-	    }
-	    else {
-		auth->lineage = NULL;
-	    }
-	    Py_DECREF (tmp);
-	    tmp = PyObject_GetAttrString (authobj, "honorific");
-	    if (tmp != Py_None) {
-		auth->honorific = g_strdup (PyUnicode_AsUTF8 (tmp));
-	    }
-	    else {
-		auth->honorific = NULL;
+
+	    attr [0] = PyObject_GetAttrString (authobj, "honorific");
+	    attr [1] = PyObject_GetAttrString (authobj, "first");
+	    attr [2] = PyObject_GetAttrString (authobj, "last");
+	    attr [3] = PyObject_GetAttrString (authobj, "lineage");
+
+	    /* the names are copied in the group, and can go afterward */
+	    auth.honorific = (attr [0] != Py_None) ? (gchar *) PyUnicode_AsUTF8 (attr [0]) : NULL;
+	    auth.first     = (attr [1] != Py_None) ? (gchar *) PyUnicode_AsUTF8 (attr [1]) : NULL;
+	    auth.last      = (attr [2] != Py_None) ? (gchar *) PyUnicode_AsUTF8 (attr [2]) : NULL;
+	    auth.lineage   = (attr [3] != Py_None) ? (gchar *) PyUnicode_AsUTF8 (attr [3]) : NULL;
+
+	    bibtex_author_group_add (field->field.author, & auth);
+
+	    for (j = 0; j < 4; j ++) {
+		Py_DECREF (attr [j]);
 	    }
-	    Py_DECREF (tmp);
 
 	    Py_DECREF(authobj);
 	}
     }
 
-    bibtex_reverse_field (field, brace, quote);
+    return field;
+
+ error:
+    bibtex_field_destroy (field, TRUE);
+    return NULL;
+}
+
+static PyObject *
+field_object (BibtexField * field)
+{
+    PyObject * tmp;
 
     tmp = (PyObject *) PyObject_NEW (PyBibtexField_Object, & PyBibtexField_Type);
     if (tmp == NULL) return NULL;
 
     ((PyBibtexField_Object *) tmp)->obj = field;
+    ((PyBibtexField_Object *) tmp)->source = NULL;
+    return tmp;
+}
+
+static char bib_reverse_doc[] =
+    "reverse(field_type, use_braces, content) -> BibtexField\n\n";
+
+static PyObject *
+bib_reverse (PyObject * self, PyObject * args)
+{
+    BibtexField * field;
+    PyObject * tuple, * tmp;
+    BibtexFieldType type;
+
+    gint brace;
+
+    if (! PyArg_ParseTuple(args, "iiO:reverse", & type, & brace, & tuple))
+	return NULL;
+
+    field = field_from_native (type, tuple);
+    if (field == NULL) return NULL;
+
+    bibtex_reverse_field (field, brace, type != BIBTEX_VERBATIM);
+
+    tmp = field_object (field);
+    if (tmp == NULL) {
+	bibtex_field_destroy (field, TRUE);
+    }
+
     return tmp;
 }
 
+static char bib_reverse_all_doc[] =
+    "reverse_all(field_type, use_braces, contents, threads) -> List\n\n"
+    "Same as reverse, for all the values of a sequence at once. The\n"
+    "fields are built by several threads.\n\n"
+    "Args:\n"
+    "    field_type (int) -- The type shared by all the values.\n"
+    "    use_braces (bool) -- Enclose the values in braces.\n"
+    "    contents (sequence) -- The values, as given to reverse.\n"
+    "    threads (int) -- Number of threads, 0 for one per processor.\n"
+    "Returns:\n"
+    "    A list of BibtexField, in the order of `contents`\n";
+
+static PyObject *
+bib_reverse_all (PyObject * self, PyObject * args)
+{
+    BibtexField * field;
+    PyObject * sequence, * items, * list, * tmp;
+    BibtexFieldType type;
+    GPtrArray * fields;
+
+    gint brace, threads;
+    Py_ssize_t length, i;
+
+    if (! PyArg_ParseTuple(args, "iiOi:reverse_all", & type, & brace, 
+			   & sequence, & threads))
+	return NULL;
+
+    items = PySequence_Fast (sequence, "contents must be a sequence");
+    if (items == NULL) return NULL;
+
+    length = PySequence_Fast_GET_SIZE (items);
+    fields = g_ptr_array_sized_new (length);
+
+    for (i = 0; i < length; i ++) {
+	field = field_from_native (type, PySequence_Fast_GET_ITEM (items, i));
+
+	if (field == NULL) {
+	    while (i -- > 0) {
+		bibtex_field_destroy (g_ptr_array_index (fields, i), TRUE);
+	    }
+	    g_ptr_array_free (fields, TRUE);
+	    Py_DECREF (items);
+
+	    return NULL;
+	}
+
+	g_ptr_array_add (fields, field);
+    }
+
+    Py_DECREF (items);
+
+    Py_BEGIN_ALLOW_THREADS
+    bibtex_reverse_fields (fields, brace, type != BIBTEX_VERBATIM, threads);
+    Py_END_ALLOW_THREADS
+
+    list = PyList_New (length);
+
+    for (i = 0; i < length; i ++) {
+	field = g_ptr_array_index (fields, i);
+	tmp   = list ? field_object (field) : NULL;
+
+	if (tmp == NULL) {
+	    /* the fields already in the list go along with it */
+	    bibtex_field_destroy (field, TRUE);
+	    Py_CLEAR (list);
+	    continue;
+	}
+
+	PyList_SET_ITEM (list, i, tmp);
+    }
+
+    g_ptr_array_free (fields, TRUE);
+
+    return list;
+}
+
 static char bib_set_offset_doc[] =
     "set_offset(source)\n\n";
 
@@ -851,7 +1835,9 @@ bib_set_offset (PyObject * self, PyObject * args)
 
     file = file_obj->obj;
 
+    source_lock (file_obj);
     bibtex_source_set_offset (file, offset);
+    source_unlock (file_obj);
 
     if (file->error) {
 	return NULL;
@@ -877,7 +1863,9 @@ bib_get_offset (PyObject * self, PyObject * args)
 
     file = file_obj->obj;
 
+    source_lock (file_obj);
     offset = bibtex_source_get_offset (file);
+    source_unlock (file_obj);
     
     tmp = PyLong_FromLong ((long) offset);
     return tmp;
@@ -886,17 +1874,27 @@ bib_get_offset (PyObject * self, PyObject * args)
 
 static PyMethodDef bibtexMeth [] = {
     { "open_file", bib_open_file, METH_VARARGS, bib_open_file_doc },
+    { "open_mmap", bib_open_mmap, METH_VARARGS, bib_open_mmap_doc },
     { "open_string", bib_open_string, METH_VARARGS, bib_open_string_doc },
     { "next", bib_next, METH_VARARGS, bib_next_doc },
+    { "next_many", bib_next_many, METH_VARARGS, bib_next_many_doc },
     { "next_unfiltered", bib_next_unfiltered, METH_VARARGS, bib_next_unfiltered_doc },
+    { "parse_all", bib_parse_all, METH_VARARGS, bib_parse_all_doc },
+    { "load_all", bib_load_all, METH_VARARGS, bib_load_all_doc },
+    { "write", bib_write, METH_VARARGS, bib_write_doc },
+    { "patch", bib_patch, METH_VARARGS, bib_patch_doc },
+    { "use_region", bib_use_region, METH_VARARGS, bib_use_region_doc },
+    { "set_lazy", bib_set_lazy, METH_VARARGS, bib_set_lazy_doc },
     { "first", bib_first, METH_VARARGS, bib_first_doc },
     { "set_offset", bib_set_offset, METH_VARARGS, bib_set_offset_doc },
     { "get_offset", bib_get_offset, METH_VARARGS, bib_get_offset_doc },
     { "expand", bib_expand, METH_VARARGS, bib_expand_doc, },
+    { "get_authors", bib_get_authors, METH_VARARGS, bib_get_authors_doc },
     { "get_native", bib_get_native, METH_VARARGS, bib_get_native_doc },
     { "get_latex", bib_get_latex, METH_VARARGS, bib_get_latex_doc },
     { "set_native", bib_set_native, METH_VARARGS, bib_set_native_doc },
     { "reverse", bib_reverse, METH_VARARGS, bib_reverse_doc },
+    { "reverse_all", bib_reverse_all, METH_VARARGS, bib_reverse_all_doc },
     { "get_dict", bib_get_dict, METH_VARARGS, bib_get_dict_doc },
     { "set_string", bib_set_string, METH_VARARGS, bib_set_string_doc },
     { "copy_field", bib_copy_field, METH_VARARGS, bib_copy_field_doc },
@@ -0,0 +1,248 @@
+/*
+ This file is part of pybliographer
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "bibtex.h"
+
+/* size of a new table; always a power of two */
+#define DICT_MIN_SIZE 16
+
+typedef struct {
+    guint hash;
+    gsize length;
+
+    /* in lower case; NULL for a free slot */
+    gchar * key;
+    gpointer value;
+}
+BibtexDictSlot;
+
+struct _BibtexDict {
+    BibtexDictSlot * slots;
+    guint size, used;
+};
+
+
+/* FNV-1a, on the text as if it were in lower case */
+static guint
+fold_hash (const gchar * text,
+	   gsize length) {
+    guint hash = 2166136261U;
+    gsize i;
+
+    for (i = 0; i < length; i ++) {
+	hash ^= (guchar) g_ascii_tolower (text [i]);
+	hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+static gboolean
+fold_equal (const gchar * key,
+	    const gchar * text,
+	    gsize length) {
+    gsize i;
+
+    for (i = 0; i < length; i ++) {
+	if (key [i] != g_ascii_tolower (text [i])) return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+   The slot holding the key, or the free slot where it would go. The
+   table is never full, so that there always is one.
+*/
+static BibtexDictSlot *
+find_slot (BibtexDict * dict,
+	   const gchar * text,
+	   gsize length,
+	   guint hash) {
+    BibtexDictSlot * slot;
+    guint mask = dict->size - 1, i;
+
+    for (i = hash & mask; ; i = (i + 1) & mask) {
+	slot = & dict->slots [i];
+
+	if (slot->key == NULL) return slot;
+
+	if (slot->hash == hash && slot->length == length &&
+	    fold_equal (slot->key, text, length)) {
+	    return slot;
+	}
+    }
+}
+
+static void
+grow (BibtexDict * dict) {
+    BibtexDictSlot * old = dict->slots, * slot;
+    guint size = dict->size, i;
+
+    dict->size  = size * 2;
+    dict->slots = g_new0 (BibtexDictSlot, dict->size);
+
+    for (i = 0; i < size; i ++) {
+	if (old [i].key == NULL) continue;
+
+	slot = find_slot (dict, old [i].key, old [i].length, old [i].hash);
+	* slot = old [i];
+    }
+
+    g_free (old);
+}
+
+
+BibtexDict *
+bibtex_dict_new (void) {
+    BibtexDict * dict = g_new (BibtexDict, 1);
+
+    dict->size  = DICT_MIN_SIZE;
+    dict->used  = 0;
+    dict->slots = g_new0 (BibtexDictSlot, dict->size);
+
+    return dict;
+}
+
+void
+bibtex_dict_destroy (BibtexDict * dict) {
+    guint i;
+
+    g_return_if_fail (dict != NULL);
+
+    for (i = 0; i < dict->size; i ++) {
+	g_free (dict->slots [i].key);
+    }
+
+    g_free (dict->slots);
+    g_free (dict);
+}
+
+gpointer
+bibtex_dict_lookup (BibtexDict * dict,
+		    const gchar * text,
+		    gssize length) {
+    BibtexDictSlot * slot;
+
+    g_return_val_if_fail (dict != NULL, NULL);
+    g_return_val_if_fail (text != NULL, NULL);
+
+    if (length < 0) {
+	length = strlen (text);
+    }
+
+    slot = find_slot (dict, text, length, fold_hash (text, length));
+
+    return slot->value;
+}
+
+gpointer
+bibtex_dict_insert (BibtexDict * dict,
+		    const gchar * text,
+		    gssize length,
+		    gpointer value) {
+    BibtexDictSlot * slot;
+    gpointer previous;
+    guint hash;
+    gssize i;
+
+    g_return_val_if_fail (dict != NULL, NULL);
+    g_return_val_if_fail (text != NULL, NULL);
+
+    if (length < 0) {
+	length = strlen (text);
+    }
+
+    hash = fold_hash (text, length);
+    slot = find_slot (dict, text, length, hash);
+
+    if (slot->key) {
+	previous    = slot->value;
+	slot->value = value;
+
+	return previous;
+    }
+
+    slot->hash   = hash;
+    slot->length = length;
+    slot->key    = g_malloc (length + 1);
+    slot->value  = value;
+
+    for (i = 0; i < length; i ++) {
+	slot->key [i] = g_ascii_tolower (text [i]);
+    }
+    slot->key [length] = '\0';
+
+    /* keep at least a quarter of the slots free */
+    if (++ dict->used * 4 > dict->size * 3) {
+	grow (dict);
+    }
+
+    return NULL;
+}
+
+guint
+bibtex_dict_size (BibtexDict * dict) {
+    g_return_val_if_fail (dict != NULL, 0);
+
+    return dict->used;
+}
+
+void
+bibtex_dict_foreach (BibtexDict * dict,
+		     GHFunc func,
+		     gpointer user) {
+    guint i;
+
+    g_return_if_fail (dict != NULL);
+    g_return_if_fail (func != NULL);
+
+    for (i = 0; i < dict->size; i ++) {
+	if (dict->slots [i].key == NULL) continue;
+
+	func (dict->slots [i].key, dict->slots [i].value, user);
+    }
+}
+
+void
+bibtex_dict_foreach_steal (BibtexDict * dict,
+			   GHFunc func,
+			   gpointer user) {
+    guint i;
+
+    g_return_if_fail (dict != NULL);
+    g_return_if_fail (func != NULL);
+
+    for (i = 0; i < dict->size; i ++) {
+	if (dict->slots [i].key == NULL) continue;
+
+	func (dict->slots [i].key, dict->slots [i].value, user);
+
+	g_free (dict->slots [i].key);
+	dict->slots [i].key   = NULL;
+	dict->slots [i].value = NULL;
+    }
+
+    dict->used = 0;
+}
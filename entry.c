@@ -25,17 +25,40 @@
 #include "config.h"
 #endif
 
+#include <string.h>
+
 #include "bibtex.h"
 
-static void
-free_data_field (gpointer key, 
-		 gpointer value, 
-		 gpointer user) {
+/* names known in advance */
+G_DEFINE_QUARK (string,   bibtex_string)
+G_DEFINE_QUARK (comment,  bibtex_comment)
+G_DEFINE_QUARK (preamble, bibtex_preamble)
+G_DEFINE_QUARK (author,   bibtex_author)
+G_DEFINE_QUARK (title,    bibtex_title)
+G_DEFINE_QUARK (year,     bibtex_year)
+
+GQuark
+bibtex_quark (const gchar * text,
+	      gsize length) {
+    gchar buffer [64], * name;
+    GQuark quark;
+    gsize i;
+
+    /* most names are short enough to be lowered on the stack */
+    name = (length < sizeof (buffer)) ? buffer : g_malloc (length + 1);
+
+    for (i = 0; i < length; i ++) {
+	name [i] = g_ascii_tolower (text [i]);
+    }
+    name [length] = '\0';
+
+    quark = g_quark_from_string (name);
 
-    g_free (key);
-    if (user) {
-	bibtex_field_destroy ((BibtexField *) value, TRUE);
+    if (name != buffer) {
+	g_free (name);
     }
+
+    return quark;
 }
 
 
@@ -45,23 +68,25 @@ bibtex_entry_new (void) {
     
     entry->length = 0;
 
-    entry->name = entry->type = NULL;
+    entry->type = 0;
+    entry->name = NULL;
     entry->preamble = NULL;
     entry->textual_preamble = NULL;
     
-    entry->table = g_hash_table_new (g_str_hash, g_str_equal);
+    entry->fields     = entry->local;
+    entry->n_fields   = 0;
+    entry->max_fields = BIBTEX_ENTRY_FIELDS;
 
     return entry;
 }
+
 void 
 bibtex_entry_destroy (BibtexEntry * entry,
 		      gboolean content) {
+    guint i;
 
     g_return_if_fail (entry != NULL);
 
-    if (entry->type)
-	g_free (entry->type);
-
     if (entry->name)
 	g_free (entry->name);
 
@@ -71,8 +96,91 @@ bibtex_entry_destroy (BibtexEntry * entry,
     if (entry->preamble) 
 	bibtex_struct_destroy (entry->preamble, TRUE);
 
-    g_hash_table_foreach (entry->table, free_data_field, GINT_TO_POINTER(content));
-    g_hash_table_destroy (entry->table);
+    for (i = 0; i < entry->n_fields; i ++) {
+	bibtex_field_destroy (entry->fields [i].field, content);
+    }
+
+    if (entry->fields != entry->local) {
+	g_free (entry->fields);
+    }
 
     g_free (entry);
 }
+
+/* Position of name in the fields, or where it should be inserted */
+static guint
+field_position (BibtexEntry * entry,
+		GQuark name) {
+    guint low = 0, high = entry->n_fields, middle;
+
+    while (low < high) {
+	middle = (low + high) / 2;
+
+	if (entry->fields [middle].name < name) {
+	    low = middle + 1;
+	}
+	else {
+	    high = middle;
+	}
+    }
+
+    return low;
+}
+
+BibtexField *
+bibtex_entry_get_field (BibtexEntry * entry,
+			GQuark name) {
+    guint i;
+
+    g_return_val_if_fail (entry != NULL, NULL);
+
+    i = field_position (entry, name);
+
+    if (i < entry->n_fields && entry->fields [i].name == name) {
+	return entry->fields [i].field;
+    }
+
+    return NULL;
+}
+
+BibtexField *
+bibtex_entry_set_field (BibtexEntry * entry,
+			GQuark name,
+			BibtexField * field) {
+    BibtexField * previous;
+    guint i;
+
+    g_return_val_if_fail (entry != NULL, NULL);
+    g_return_val_if_fail (field != NULL, NULL);
+
+    i = field_position (entry, name);
+
+    if (i < entry->n_fields && entry->fields [i].name == name) {
+	previous = entry->fields [i].field;
+	entry->fields [i].field = field;
+
+	return previous;
+    }
+
+    if (entry->n_fields == entry->max_fields) {
+	entry->max_fields *= 2;
+
+	if (entry->fields == entry->local) {
+	    entry->fields = g_new (BibtexEntryField, entry->max_fields);
+	    memcpy (entry->fields, entry->local, sizeof (entry->local));
+	}
+	else {
+	    entry->fields = g_renew (BibtexEntryField, entry->fields, 
+				     entry->max_fields);
+	}
+    }
+
+    memmove (entry->fields + i + 1, entry->fields + i,
+	     (entry->n_fields - i) * sizeof (BibtexEntryField));
+
+    entry->fields [i].name  = name;
+    entry->fields [i].field = field;
+    entry->n_fields ++;
+
+    return NULL;
+}
@@ -31,11 +31,20 @@
 
 BibtexField *
 bibtex_field_new (BibtexFieldType type) {
-    BibtexField * field = g_new (BibtexField, 1);
+    BibtexField * field = bibtex_alloc (sizeof (BibtexField));
     
+    field->in_region = (bibtex_region_current () != NULL);
     field->structure = NULL;
+    field->raw = NULL;
+    field->raw_length = 0;
+    field->raw_name = NULL;
+    field->raw_line = 0;
+    field->raw_source = NULL;
+    field->raw_prev = field->raw_next = NULL;
     field->type = type;
     field->text = NULL;
+    field->macros = NULL;
+    field->stamp = 0;
     field->converted = FALSE;
     field->loss = FALSE;
 
@@ -71,6 +80,8 @@ bibtex_field_destroy (BibtexField * field,
 		      gboolean value) {
 
     g_return_if_fail (field != NULL);
+
+    bibtex_field_drop_raw (field);
     
     if (value && field->structure) {
 	bibtex_struct_destroy (field->structure, TRUE);
@@ -80,6 +91,10 @@ bibtex_field_destroy (BibtexField * field,
 	g_free (field->text);
     }
 
+    if (field->macros) {
+	g_ptr_array_free (field->macros, TRUE);
+    }
+
     switch (field->type) {
 	
     case BIBTEX_AUTHOR:
@@ -92,7 +107,9 @@ bibtex_field_destroy (BibtexField * field,
       break;
     }
 
-    g_free (field);
+    if (! field->in_region) {
+	g_free (field);
+    }
 }
 
 
@@ -111,30 +128,303 @@ bibtex_struct_as_field (BibtexStruct * s,
     return field;
 }
 
+/* each thread parses isolated values with a source of its own */
+static void
+free_value_source (gpointer data) {
+    bibtex_source_destroy ((BibtexSource *) data, TRUE);
+}
+
+static GPrivate value_source = G_PRIVATE_INIT (free_value_source);
+
+BibtexStruct *
+bibtex_struct_parse (const gchar * text,
+		     gssize length) {
+
+    return bibtex_struct_parse_at (text, length, "internal string", 1);
+}
+
+/* 
+   A value as the content of a preamble, followed by the two NUL bytes
+   the scanner needs to work in it directly.
+*/
+static gchar *
+wrap_value (const gchar * text,
+	    gsize length,
+	    gsize * size) {
+    gchar * string;
+
+    * size = length + strlen ("@preamble{}");
+    string = g_malloc (* size + 2);
+
+    memcpy (string, "@preamble{", strlen ("@preamble{"));
+    memcpy (string + strlen ("@preamble{"), text, length);
+    string [* size - 1] = '}';
+    string [* size] = string [* size + 1] = '\0';
+
+    return string;
+}
+
+/* Parse a wrapped value, and free it */
+static BibtexStruct *
+parse_wrapped (gchar * string,
+	       gsize size,
+	       const gchar * name,
+	       gint line) {
+    BibtexSource * source;
+    BibtexEntry * entry;
+    BibtexStruct * s = NULL;
+
+    source = g_private_get (& value_source);
+
+    if (source == NULL) {
+	source = bibtex_source_new ();
+	g_private_set (& value_source, source);
+    }
+
+    bibtex_source_scan (source, (gchar *) name, string, size);
+
+    /* the value is on a single line with its preamble */
+    source->line = line;
+
+    entry = bibtex_analyzer_parse (source);
+
+    /* the source no longer looks at the text once it is parsed */
+    g_free (string);
+
+    if (entry) {
+	s = entry->preamble;
+	entry->preamble = NULL;
+
+	bibtex_entry_destroy (entry, TRUE);
+    }
+
+    return s;
+}
+
+BibtexStruct *
+bibtex_struct_parse_at (const gchar * text,
+			gssize length,
+			const gchar * name,
+			gint line) {
+    gchar * string;
+    gsize size;
+
+    g_return_val_if_fail (text != NULL, NULL);
+
+    if (length < 0) {
+	length = strlen (text);
+    }
+
+    /* parse the value on its own, as the content of a preamble */
+    string = wrap_value (text, length, & size);
+
+    return parse_wrapped (string, size, name, line);
+}
+
+BibtexStruct *
+bibtex_field_get_structure (BibtexField * field) {
+    BibtexSource * source;
+    BibtexStruct * s;
+    gchar * string;
+    gsize size;
+
+    g_return_val_if_fail (field != NULL, NULL);
+
+    if (field->structure || field->raw == NULL) {
+	return field->structure;
+    }
+
+    /* 
+       The text is copied as the source holds it: a patch might move
+       it meanwhile. No message is emitted with the lock held.
+    */
+    source = field->raw_source;
+
+    if (source) g_mutex_lock (& source->raw_lock);
+    string = wrap_value (field->raw, field->raw_length, & size);
+    if (source) g_mutex_unlock (& source->raw_lock);
+
+    s = parse_wrapped (string, size, field->raw_name, field->raw_line);
+
+    /* the text is kept, and parsed again next time */
+    if (s == NULL) return NULL;
+
+    field->structure = bibtex_struct_flatten (s);
+    bibtex_field_drop_raw (field);
+
+    return field->structure;
+}
+
+void
+bibtex_field_set_raw (BibtexField * field,
+		      BibtexSource * source,
+		      const gchar * text,
+		      gsize length,
+		      gint line) {
+    g_return_if_fail (field != NULL);
+    g_return_if_fail (source != NULL);
+
+    bibtex_field_drop_raw (field);
+
+    field->raw        = text;
+    field->raw_length = length;
+    field->raw_name   = source->name;
+    field->raw_line   = line;
+    field->raw_source = source;
+
+    g_mutex_lock (& source->raw_lock);
+
+    field->raw_prev = NULL;
+    field->raw_next = source->raw_fields;
+
+    if (source->raw_fields) {
+	source->raw_fields->raw_prev = field;
+    }
+    source->raw_fields = field;
+
+    g_mutex_unlock (& source->raw_lock);
+}
+
+/* Take the field out of the list of its source, locked */
+static void
+unlink_raw (BibtexField * field) {
+    BibtexSource * source = field->raw_source;
+
+    if (field->raw_prev) {
+	field->raw_prev->raw_next = field->raw_next;
+    }
+    else {
+	source->raw_fields = field->raw_next;
+    }
+
+    if (field->raw_next) {
+	field->raw_next->raw_prev = field->raw_prev;
+    }
+
+    field->raw_prev = field->raw_next = NULL;
+}
+
+void
+bibtex_field_move_raw (BibtexField * field,
+		       BibtexSource * source) {
+    g_return_if_fail (field != NULL);
+    g_return_if_fail (source != NULL);
+
+    if (field->raw == NULL) return;
+
+    if (field->raw_source == NULL) {
+	field->raw_name = source->name;
+	return;
+    }
+
+    g_mutex_lock (& field->raw_source->raw_lock);
+    unlink_raw (field);
+    g_mutex_unlock (& field->raw_source->raw_lock);
+
+    field->raw_source = NULL;
+
+    bibtex_field_set_raw (field, source, field->raw, field->raw_length,
+			  field->raw_line);
+}
+
+void
+bibtex_field_drop_raw (BibtexField * field) {
+    BibtexSource * source;
+
+    g_return_if_fail (field != NULL);
+
+    source = field->raw_source;
+
+    if (source) {
+	g_mutex_lock (& source->raw_lock);
+	unlink_raw (field);
+	g_mutex_unlock (& source->raw_lock);
+    }
+
+    field->raw        = NULL;
+    field->raw_source = NULL;
+}
+
+/* Is the converted text of the field still that of its macros ? */
+static gboolean
+is_current (BibtexField * field,
+	    BibtexSource * source) {
+    guint i;
+
+    if (! field->converted) return FALSE;
+
+    if (source == NULL || field->macros == NULL) return TRUE;
+
+    for (i = 0; i < field->macros->len; i ++) {
+	if (bibtex_source_get_stamp (source, 
+				     g_ptr_array_index (field->macros, i))
+	    > field->stamp) {
+	    return FALSE;
+	}
+    }
+
+    return TRUE;
+}
+
 BibtexField *
 bibtex_field_parse (BibtexField * field,
-		    GHashTable * dico) {
+		    BibtexSource * source) {
 
     g_return_val_if_fail (field != NULL, NULL);
 
-    if (field->converted) {
+    if (is_current (field, source)) {
 	/* Convert just once */
 	return field;
     }
 
+    if (bibtex_field_get_structure (field) == NULL && field->raw) {
+	return NULL;
+    }
+
+    /* forget a previous conversion */
+    if (field->text) {
+	g_free (field->text);
+	field->text = NULL;
+    }
+
+    if (field->type == BIBTEX_AUTHOR && field->field.author) {
+	bibtex_author_group_destroy (field->field.author);
+	field->field.author = NULL;
+    }
+
     field->converted = TRUE;
+    field->loss = FALSE;
 
     field->text = bibtex_struct_as_string (field->structure,
-					   field->type, dico, 
+					   field->type, source, 
 					   & field->loss);
 
+    /* remember what to check before trusting the text again */
+    if (field->macros) {
+	g_ptr_array_set_size (field->macros, 0);
+    }
+    else {
+	field->macros = g_ptr_array_new ();
+    }
+
+    if (field->structure) {
+	bibtex_struct_get_refs (field->structure, field->macros);
+    }
+
+    if (field->macros->len == 0) {
+	g_ptr_array_free (field->macros, TRUE);
+	field->macros = NULL;
+    }
+
+    field->stamp = source ? source->serial : 0;
+
     switch (field->type) {
     case BIBTEX_AUTHOR:
-	field->field.author = bibtex_author_parse (field->structure, dico);
+	field->field.author = bibtex_author_parse (field->structure, source);
 	break;
 
     case BIBTEX_DATE:
-	field->field.date.year  = atoi (field->text);
+	field->field.date.year  = field->text ? atoi (field->text) : 0;
 	field->field.date.month = 0;
 	field->field.date.day   = 0;
 	break;
@@ -9,16 +9,24 @@ extern "C" {
 #define BIB_LEVEL_WARNING (1 << (G_LOG_LEVEL_USER_SHIFT + 1))
 #define BIB_LEVEL_MESSAGE (1 << (G_LOG_LEVEL_USER_SHIFT + 2))
     
+    void bibtex_log  (GLogLevelFlags level, const gchar * format, ...);
+    void bibtex_logv (GLogLevelFlags level, const gchar * format, 
+		      va_list args);
+
+    /* 
+       Keep the messages of the current thread in a queue instead of
+       emitting them, until they are flushed (and emitted, or dropped).
+    */
+    void bibtex_messages_defer (GQueue * queue);
+    void bibtex_messages_flush (GQueue * queue, gboolean emit);
+
 #ifdef  __GNUC__
-#define bibtex_error(format, args...)        g_log (G_LOG_DOMAIN, \
-                                               BIB_LEVEL_ERROR, \
-                                               format, ##args)
-#define bibtex_message(format, args...)      g_log (G_LOG_DOMAIN, \
-                                               BIB_LEVEL_MESSAGE, \
-                                               format, ##args)
-#define bibtex_warning(format, args...)      g_log (G_LOG_DOMAIN, \
-                                               BIB_LEVEL_WARNING, \
-                                               format, ##args)
+#define bibtex_error(format, args...)        bibtex_log (BIB_LEVEL_ERROR, \
+                                                    format, ##args)
+#define bibtex_message(format, args...)      bibtex_log (BIB_LEVEL_MESSAGE, \
+                                                    format, ##args)
+#define bibtex_warning(format, args...)      bibtex_log (BIB_LEVEL_WARNING, \
+                                                    format, ##args)
 #else   /* !__GNUC__ */
 
     static inline void
@@ -27,7 +35,7 @@ extern "C" {
     {
 	va_list args;
 	va_start (args, format);
-	g_logv (G_LOG_DOMAIN, BIB_LEVEL_ERROR, format, args);
+	bibtex_logv (BIB_LEVEL_ERROR, format, args);
 	va_end (args);
     }
 
@@ -37,7 +45,7 @@ extern "C" {
     {
 	va_list args;
 	va_start (args, format);
-	g_logv (G_LOG_DOMAIN, BIB_LEVEL_MESSAGE, format, args);
+	bibtex_logv (BIB_LEVEL_MESSAGE, format, args);
 	va_end (args);
     }
 
@@ -47,7 +55,7 @@ extern "C" {
     {
 	va_list args;
 	va_start (args, format);
-	g_logv (G_LOG_DOMAIN, BIB_LEVEL_WARNING, format, args);
+	bibtex_logv (BIB_LEVEL_WARNING, format, args);
 	va_end (args);
     }
 #endif /* !GNUC */
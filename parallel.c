@@ -0,0 +1,400 @@
+/*
+ This file is part of pybliographer
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "bibtex.h"
+
+/* smaller texts are not worth splitting */
+#define CHUNK_MIN_SIZE    (64 * 1024)
+
+/* several chunks per thread even out their parsing times */
+#define CHUNKS_PER_THREAD 4
+
+/*
+   A part of the text, starting with an entry, that is parsed on its
+   own by one of the threads.
+*/
+typedef struct {
+    gint start, end;
+    gint line, end_line;
+
+    BibtexSource * source;
+    GPtrArray    * entries;
+    GQueue       * messages;
+
+    /* did its parsing stop cleanly at its end ? */
+    gboolean valid;
+}
+BibtexChunk;
+
+typedef struct {
+    BibtexSource * source;
+    const gchar  * text;
+    gboolean filter;
+}
+BibtexChunkJob;
+
+
+static BibtexChunk *
+chunk_new (gint start, gint line) {
+    BibtexChunk * chunk = g_new (BibtexChunk, 1);
+
+    chunk->start    = start;
+    chunk->end      = start;
+    chunk->line     = line;
+    chunk->end_line = line;
+
+    chunk->source   = NULL;
+    chunk->entries  = g_ptr_array_new ();
+    chunk->messages = g_queue_new ();
+
+    chunk->valid    = FALSE;
+
+    return chunk;
+}
+
+/* @string definitions are shared with the table of their source */
+static void
+entry_drop (BibtexEntry * entry) {
+    bibtex_entry_destroy (entry, entry->type != bibtex_string_quark ());
+}
+
+static void
+chunk_destroy (BibtexChunk * chunk) {
+    guint i;
+
+    for (i = 0; i < chunk->entries->len; i ++) {
+	entry_drop (g_ptr_array_index (chunk->entries, i));
+    }
+    g_ptr_array_free (chunk->entries, TRUE);
+
+    bibtex_messages_flush (chunk->messages, FALSE);
+    g_queue_free (chunk->messages);
+
+    /* 
+       The table of a chunk that was merged is empty by now. Otherwise
+       it still owns its @string definitions, even those handed out in
+       the dropped entries.
+    */
+    if (chunk->source) {
+	bibtex_source_destroy (chunk->source, TRUE);
+    }
+
+    g_free (chunk);
+}
+
+
+/*
+   Cut the text into chunks of about size bytes. A chunk starts where
+   the scanner would start an entry, ie on a @ at the beginning of a
+   line.
+*/
+static GPtrArray *
+split_chunks (const gchar * text,
+	      gint start, gint length,
+	      gint line, gint size) {
+    GPtrArray * chunks = g_ptr_array_new ();
+    BibtexChunk * chunk;
+
+    const gchar * current = text + start, * end = text + length, * tmp;
+
+    chunk = chunk_new (start, line);
+    g_ptr_array_add (chunks, chunk);
+
+    while ((tmp = memchr (current, '\n', end - current)) != NULL) {
+	current = tmp + 1;
+	line ++;
+
+	if (current - text - chunk->start < size) continue;
+
+	tmp = current;
+	while (tmp < end && (* tmp == ' ' || * tmp == '\t')) tmp ++;
+
+	if (tmp == end || * tmp != '@') continue;
+
+	chunk->end = current - text;
+
+	chunk = chunk_new (current - text, line);
+	g_ptr_array_add (chunks, chunk);
+    }
+
+    chunk->end = length;
+
+    return chunks;
+}
+
+
+/* 
+   Lazy fields already point in the text of the whole source, but
+   belong to the chunk: they move to the source, which outlives it.
+*/
+static void
+move_fields (BibtexEntry * entry,
+	     BibtexSource * source) {
+    guint i;
+
+    for (i = 0; i < entry->n_fields; i ++) {
+	bibtex_field_move_raw (entry->fields [i].field, source);
+    }
+}
+
+/* Thread pool callback: parse a single chunk */
+static void
+parse_chunk (gpointer data,
+	     gpointer user) {
+    BibtexChunk    * chunk = (BibtexChunk *) data;
+    BibtexChunkJob * job   = (BibtexChunkJob *) user;
+
+    BibtexSource * source;
+    BibtexEntry  * entry;
+    gint from;
+
+    /* the messages are emitted later, in the order of the file */
+    bibtex_messages_defer (chunk->messages);
+
+    source = bibtex_source_new ();
+
+    source->strict = job->source->strict;
+    source->debug  = job->source->debug;
+    source->lazy   = job->source->lazy;
+
+    if (job->source->region) {
+	bibtex_source_use_region (source);
+    }
+
+    /* keep the previous character, to know if we start on a new line */
+    from = (chunk->start > 0) ? chunk->start - 1 : 0;
+
+    /* the chunk is only copied once, by the scanner */
+    bibtex_source_buffer (source, job->source->name,
+			  job->text + from, chunk->end - from);
+
+    bibtex_source_set_offset (source, chunk->start - from);
+
+    /* report the positions in the whole text */
+    source->offset = chunk->start;
+    source->line   = chunk->line;
+
+    while ((entry = bibtex_source_next_entry (source, job->filter)) != NULL) {
+	g_ptr_array_add (chunk->entries, entry);
+    }
+
+    chunk->source   = source;
+    chunk->valid    = source->eof;
+    chunk->end_line = source->line;
+
+    bibtex_messages_defer (NULL);
+}
+
+
+static gint
+chunk_start (GPtrArray * chunks,
+	     guint i) {
+    return ((BibtexChunk *) g_ptr_array_index (chunks, i))->start;
+}
+
+/* 
+   Does the scanner, after an entry that ends at offset, start the
+   next one at start ? Only if no entry can start in between.
+*/
+static gboolean
+lands_on (const gchar * text,
+	  gint offset,
+	  gint start) {
+    return (offset <= start &&
+	    memchr (text + offset, '@', start - offset) == NULL);
+}
+
+static void
+merge_string (gpointer key,
+	      gpointer value,
+	      gpointer user) {
+
+    bibtex_source_set_string ((BibtexSource *) user,
+			      (gchar *) key, (BibtexStruct *) value);
+}
+
+static void
+add_entry (GPtrArray * entries,
+	   BibtexEntry * entry,
+	   gint * last) {
+
+    /* an entry covers everything since the end of the previous one */
+    entry->length += entry->offset - * last;
+    entry->offset  = * last;
+
+    * last = entry->offset + entry->length;
+
+    g_ptr_array_add (entries, entry);
+}
+
+
+GPtrArray *
+bibtex_source_parse_all (BibtexSource * source,
+			 gboolean filter,
+			 gint threads) {
+    GPtrArray * entries, * chunks = NULL;
+    BibtexChunk * chunk;
+    BibtexChunkJob job;
+    BibtexEntry * entry;
+    GThreadPool * pool;
+
+    const gchar * text = NULL;
+    gint length = 0, last, size, resume;
+    gboolean stopped = FALSE;
+    guint i, j;
+
+    g_return_val_if_fail (source != NULL, NULL);
+
+    entries = g_ptr_array_new ();
+
+    if (source->eof) return entries;
+
+    switch (source->type) {
+    case BIBTEX_SOURCE_STRING:
+	text   = source->source.string.text;
+	length = source->source.string.length;
+	break;
+
+    case BIBTEX_SOURCE_MMAP:
+	text   = source->source.map.data;
+	length = source->source.map.length;
+	break;
+
+    default:
+	/* files are only read sequentially */
+	break;
+    }
+
+    if (threads <= 0) {
+	threads = g_get_num_processors ();
+    }
+
+    last = source->offset;
+
+    if (text != NULL && threads > 1 &&
+	length - source->offset >= 2 * CHUNK_MIN_SIZE) {
+
+	size = MAX ((length - source->offset) /
+		    (threads * CHUNKS_PER_THREAD), CHUNK_MIN_SIZE);
+
+	chunks = split_chunks (text, source->offset, length,
+			       source->line, size);
+    }
+
+    if (chunks && chunks->len > 1) {
+	job.source = source;
+	job.text   = text;
+	job.filter = filter;
+
+	pool = g_thread_pool_new (parse_chunk, & job, threads, FALSE, NULL);
+
+	for (i = 0; i < chunks->len; i ++) {
+	    g_thread_pool_push (pool, g_ptr_array_index (chunks, i), NULL);
+	}
+
+	/* wait for all the chunks */
+	g_thread_pool_free (pool, FALSE, TRUE);
+
+	resume = source->offset;
+	i = 0;
+
+	while (i < chunks->len && ! stopped) {
+	    chunk = g_ptr_array_index (chunks, i ++);
+
+	    /*
+	       A chunk that did not end cleanly was not cut between two
+	       entries (a line starting with @ inside a field), or holds
+	       an error: it is parsed again sequentially, up to the start
+	       of a later chunk the parse lands on, whose entries are
+	       then the same.
+	    */
+	    if (! chunk->valid) {
+		bibtex_source_set_offset (source, chunk->start);
+		source->line = chunk->line;
+
+		while ((entry = bibtex_source_next_entry (source, filter))
+		       != NULL) {
+		    add_entry (entries, entry, & last);
+
+		    while (i < chunks->len &&
+			   chunk_start (chunks, i) < source->offset) i ++;
+
+		    if (i < chunks->len &&
+			lands_on (text, source->offset,
+				  chunk_start (chunks, i))) break;
+		}
+
+		/* on error, the source is left after the faulty entry */
+		stopped = (entry == NULL);
+		resume  = source->offset;
+		continue;
+	    }
+
+	    bibtex_messages_flush (chunk->messages, TRUE);
+
+	    bibtex_dict_foreach_steal (chunk->source->table,
+				       merge_string, source);
+
+	    for (j = 0; j < chunk->entries->len; j ++) {
+		entry = g_ptr_array_index (chunk->entries, j);
+
+		move_fields (entry, source);
+		add_entry (entries, entry, & last);
+	    }
+	    g_ptr_array_set_size (chunk->entries, 0);
+
+	    /* the entries now live as long as the whole source */
+	    if (chunk->source->region) {
+		bibtex_region_merge (source->region, chunk->source->region);
+		chunk->source->region = NULL;
+	    }
+
+	    resume       = chunk->end;
+	    source->line = chunk->end_line;
+	}
+
+	if (! stopped) {
+	    bibtex_source_set_offset (source, resume);
+	}
+    }
+
+    if (chunks) {
+	for (i = 0; i < chunks->len; i ++) {
+	    chunk_destroy (g_ptr_array_index (chunks, i));
+	}
+	g_ptr_array_free (chunks, TRUE);
+    }
+
+    /* 
+       Parse whatever remains. On error, the source is left after the
+       faulty entry, as with bibtex_source_next_entry, and the entries
+       before it are kept.
+    */
+    while (! stopped &&
+	   (entry = bibtex_source_next_entry (source, filter)) != NULL) {
+	add_entry (entries, entry, & last);
+    }
+
+    return entries;
+}
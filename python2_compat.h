@@ -25,6 +25,16 @@
 #undef PyUnicode_FromString
 #define PyUnicode_FromString(s) PyString_FromString(s)
 #define PyUnicode_AsUTF8(s) PyString_AsString(s)
+#define PyUnicode_AsUTF8AndSize(s, n) compat_as_string_and_size(s, n)
 #define PyLong_AsLong(i) PyInt_AsLong(i)
 #define PyLong_FromLong(l) PyInt_FromLong(l)
+
+static inline const char *
+compat_as_string_and_size (PyObject * s, Py_ssize_t * size)
+{
+    char * text;
+
+    if (PyString_AsStringAndSize (s, & text, size) == -1) return NULL;
+    return text;
+}
 #endif
@@ -0,0 +1,199 @@
+/*
+ This file is part of pybliographer
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "bibtex.h"
+
+#define SLAB_SIZE   (64 * 1024)
+
+/* every allocation is aligned on this size */
+#define ALIGNMENT   (2 * sizeof (gpointer))
+#define ALIGN(size) (((size) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+/* each slab starts with a pointer to the previous one */
+#define SLAB_HEADER ALIGN (sizeof (gpointer))
+
+struct _BibtexRegion {
+    /* last slab, and its free space */
+    gchar * slab;
+    gchar * current;
+    gsize left;
+
+    /* slabs larger than usual, for big allocations */
+    gchar * large;
+};
+
+/* the region in which the current thread is allocating */
+static GPrivate current_region = G_PRIVATE_INIT (NULL);
+
+
+BibtexRegion *
+bibtex_region_new (void) {
+    BibtexRegion * region = g_new (BibtexRegion, 1);
+
+    region->slab    = NULL;
+    region->current = NULL;
+    region->left    = 0;
+    region->large   = NULL;
+
+    return region;
+}
+
+static void
+free_slabs (gchar * slab) {
+    gchar * previous;
+
+    while (slab) {
+	previous = * (gchar **) slab;
+	g_free (slab);
+	slab = previous;
+    }
+}
+
+void
+bibtex_region_destroy (BibtexRegion * region) {
+    g_return_if_fail (region != NULL);
+
+    free_slabs (region->slab);
+    free_slabs (region->large);
+
+    g_free (region);
+}
+
+gpointer
+bibtex_region_alloc (BibtexRegion * region,
+		     gsize size) {
+    gchar * slab, * data;
+
+    g_return_val_if_fail (region != NULL, NULL);
+
+    size = ALIGN (size);
+
+    if (size > SLAB_SIZE / 4) {
+	/* keep big blocks apart, so that the current slab goes on */
+	slab = g_malloc (SLAB_HEADER + size);
+
+	* (gchar **) slab = region->large;
+	region->large = slab;
+
+	return slab + SLAB_HEADER;
+    }
+
+    if (size > region->left) {
+	slab = g_malloc (SLAB_SIZE);
+
+	* (gchar **) slab = region->slab;
+	region->slab = slab;
+
+	region->current = slab + SLAB_HEADER;
+	region->left    = SLAB_SIZE - SLAB_HEADER;
+    }
+
+    data = region->current;
+
+    region->current += size;
+    region->left    -= size;
+
+    return data;
+}
+
+gchar *
+bibtex_region_strndup (BibtexRegion * region,
+		       const gchar * text,
+		       gsize length) {
+    gchar * copy;
+
+    copy = bibtex_region_alloc (region, length + 1);
+
+    memcpy (copy, text, length);
+    copy [length] = '\0';
+
+    return copy;
+}
+
+static void
+append_slabs (gchar ** slabs, gchar * other) {
+    gchar * last;
+
+    if (other == NULL) return;
+
+    for (last = other; * (gchar **) last; last = * (gchar **) last);
+
+    * (gchar **) last = * slabs;
+    * slabs = other;
+}
+
+void
+bibtex_region_merge (BibtexRegion * region,
+		     BibtexRegion * other) {
+    g_return_if_fail (region != NULL);
+    g_return_if_fail (other != NULL);
+
+    /* the free space left in the other slabs is simply lost */
+    append_slabs (& region->large, other->slab);
+    append_slabs (& region->large, other->large);
+
+    g_free (other);
+}
+
+
+BibtexRegion *
+bibtex_region_current (void) {
+    return g_private_get (& current_region);
+}
+
+BibtexRegion *
+bibtex_region_set_current (BibtexRegion * region) {
+    BibtexRegion * previous = g_private_get (& current_region);
+
+    g_private_set (& current_region, region);
+
+    return previous;
+}
+
+gpointer
+bibtex_alloc (gsize size) {
+    BibtexRegion * region = g_private_get (& current_region);
+
+    if (region == NULL) {
+	return g_malloc (size);
+    }
+
+    return bibtex_region_alloc (region, size);
+}
+
+gchar *
+bibtex_strndup (const gchar * text,
+		gssize length) {
+    BibtexRegion * region = g_private_get (& current_region);
+
+    if (length < 0) {
+	length = strlen (text);
+    }
+
+    if (region == NULL) {
+	return g_strndup (text, length);
+    }
+
+    return bibtex_region_strndup (region, text, length);
+}
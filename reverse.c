@@ -26,8 +26,6 @@
 #endif
 
 #include <string.h>
-#include <sys/types.h>
-#include <regex.h>
 
 #ifdef HAVE_STDBOOL_H
 #include <stdbool.h>
@@ -54,51 +52,199 @@ typedef enum
 
 #include <stdio.h>
 
-#include <recode.h>
-
 #include "bibtex.h"
 
 
+static gboolean
+is_space (gchar c) {
+    return (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '~');
+}
+
+/* Content of an empty group, as the parser gives it */
 static BibtexStruct *
-text_to_struct (gchar * string) {
-    BibtexEntry * entry;
-    BibtexStruct * s;
-    static BibtexSource * source = NULL;
- 
-    if (source == NULL) source = bibtex_source_new ();
- 
-    /* parse as a string */
-    if (! bibtex_source_string (source, "internal string", string)) {
-        g_error ("can't create string");
+empty_text (void) {
+    BibtexStruct * s = bibtex_struct_new (BIBTEX_STRUCT_TEXT);
+
+    s->value.text = bibtex_strndup ("", 0);
+
+    return s;
+}
+
+/* 
+   Cut the text into its parts, as the scanner and the parser would
+   inside a braced or quoted value, up to the closing brace of the
+   current level. Returns the parts, chained as the parser does.
+*/
+static BibtexStruct *
+read_parts (const gchar ** text,
+	    const gchar * end,
+	    gint depth,
+	    gboolean in_quotes,
+	    gboolean * error) {
+    BibtexStruct * parts = NULL, * part;
+    const gchar * current = * text, * start;
+
+    while (current < end && ! * error) {
+	start = current;
+
+	switch (* current) {
+	case '}':
+	    if (depth == 0) {
+		* error = TRUE;
+		continue;
+	    }
+	    * text = current;
+	    return parts;
+
+	case '{':
+	    current ++;
+
+	    part = bibtex_struct_new (BIBTEX_STRUCT_SUB);
+	    part->value.sub->encloser = BIBTEX_ENCLOSER_BRACE;
+	    part->value.sub->content  = 
+		read_parts (& current, end, depth + 1, in_quotes, error);
+
+	    if (part->value.sub->content == NULL) {
+		part->value.sub->content = empty_text ();
+	    }
+
+	    if (current == end) {
+		* error = TRUE;
+	    }
+	    else {
+		current ++;
+	    }
+	    break;
+
+	case '"':
+	    /* a quote only closes a quoted value */
+	    if (depth == 0 && in_quotes) {
+		* error = TRUE;
+		continue;
+	    }
+	    current ++;
+
+	    part = bibtex_struct_new (BIBTEX_STRUCT_TEXT);
+	    part->value.text = bibtex_strndup ("\"", 1);
+	    break;
+
+	case '\\':
+	    current ++;
+
+	    if (current == end) {
+		* error = TRUE;
+		continue;
+	    }
+
+	    if (g_ascii_isalpha (* current)) {
+		while (current < end && g_ascii_isalpha (* current)) current ++;
+	    }
+	    else {
+		current ++;
+	    }
+
+	    part = bibtex_struct_new (BIBTEX_STRUCT_COMMAND);
+	    part->value.com = bibtex_strndup (start + 1, current - start - 1);
+	    break;
+
+	default:
+	    if (is_space (* current)) {
+		while (current < end && is_space (* current)) current ++;
+
+		part = bibtex_struct_new (BIBTEX_STRUCT_SPACE);
+		part->value.unbreakable = (current - start == 1 && * start == '~');
+		break;
+	    }
+
+	    while (current < end && ! is_space (* current) &&
+		   strchr ("{}\\\"", * current) == NULL) {
+		current ++;
+	    }
+
+	    part = bibtex_struct_new (BIBTEX_STRUCT_TEXT);
+	    part->value.text = bibtex_strndup (start, current - start);
+	    break;
+	}
+
+	parts = bibtex_struct_append (parts, part);
     }
- 
-    entry = bibtex_source_next_entry (source, FALSE);
- 
-    if (entry == NULL) {
-        bibtex_error ("can't parse entry `%s'", string);
-        return NULL;
+
+    * text = current;
+    return parts;
+}
+
+/* 
+   Build the structure of the value held in string, between braces or
+   quotes, just as if it had been parsed.
+*/
+static BibtexStruct *
+text_to_struct (GString * string) {
+    BibtexStruct * s, * content;
+    BibtexRegion * previous;
+    const gchar * current, * end;
+    gboolean error = FALSE, in_quotes;
+
+    in_quotes = (string->str [0] == '"');
+
+    current = string->str + 1;
+    end     = string->str + string->len - 1;
+
+    /* the result belongs to the field, not to some source */
+    previous = bibtex_region_set_current (NULL);
+
+    content = read_parts (& current, end, 0, in_quotes, & error);
+
+    if (error) {
+	if (content) {
+	    bibtex_struct_destroy (content, TRUE);
+	}
+
+	bibtex_region_set_current (previous);
+	bibtex_error ("can't parse `%s'", string->str);
+
+	return NULL;
     }
- 
-    s = bibtex_struct_copy (entry->preamble);
-     
-    bibtex_entry_destroy (entry, TRUE);
- 
+
+    if (content == NULL) {
+	content = empty_text ();
+    }
+
+    s = bibtex_struct_new (BIBTEX_STRUCT_SUB);
+    s->value.sub->encloser = 
+	in_quotes ? BIBTEX_ENCLOSER_QUOTE : BIBTEX_ENCLOSER_BRACE;
+    s->value.sub->content  = content;
+
+    bibtex_region_set_current (previous);
+
     return s;
 }
 
+/* part of a word, for the purpose of finding a separate "and" */
+static gboolean
+is_word (gchar c) {
+    /* the bytes of UTF-8 sequences only occur in letters here */
+    return g_ascii_isalnum (c) || (guchar) c >= 0x80;
+}
+
+/* 
+   A name containing a coma or a separate "and" would be cut into
+   several authors: it has to be protected by braces.
+*/
 static gboolean
-author_needs_quotes (gchar * string) {
-  static gboolean initialized = FALSE;
-  static regex_t and_re;
-
-  if (! initialized) {
-    initialized = regcomp (& and_re, "[^[:alnum:]]and[^[:alnum:]]", REG_ICASE |
-                           REG_EXTENDED) == 0;
-    g_assert (initialized);
-  }
-  return
-    (strpbrk (string, ",") != NULL) ||
-    (regexec (& and_re, string, 0,NULL, 0)  == 0);
+author_needs_quotes (const gchar * string) {
+    const gchar * current;
+
+    for (current = string; * current; current ++) {
+	if (* current == ',') return TRUE;
+
+	if (current > string && ! is_word (current [-1]) &&
+	    g_ascii_strncasecmp (current, "and", 3) == 0 &&
+	    current [3] != '\0' && ! is_word (current [3])) {
+	    return TRUE;
+	}
+    }
+
+    return FALSE;
 }
 
 BibtexField * 
@@ -109,33 +255,25 @@ bibtex_reverse_field (BibtexField * field,
     gchar * string, * tmp;
     gboolean is_upper, has_space, is_command, was_command;
     guint i;
-    BibtexAuthor * author;
+    BibtexAuthor * author, names;
 
-    static GString *      st      = NULL;
-    static RECODE_OUTER   outer   = NULL;
-    static RECODE_REQUEST request = NULL;
+    GString * st;
 
     g_return_val_if_fail (field != NULL, NULL);
 
-    if (st == NULL) st = g_string_sized_new (16);
-	
-    if (outer == NULL) {
-	outer = recode_new_outer (false);
-	g_assert (outer != NULL);
-    }
-
-    if (request == NULL) {
-	request = recode_new_request (outer);
-	g_assert (request != NULL);
-	if (! recode_scan_request (request, "utf8..latex")) {
-	    g_error ("can't create recoder");
-	}
-    }
+    st = g_string_sized_new (16);
 
     if (field->structure) {
 	bibtex_struct_destroy (field->structure, TRUE);
 	field->structure = NULL;
     }
+    bibtex_field_drop_raw (field);
+
+    /* the names of its macros were in the structure */
+    if (field->macros) {
+	g_ptr_array_free (field->macros, TRUE);
+	field->macros = NULL;
+    }
 
     field->loss = FALSE;
 
@@ -153,29 +291,27 @@ bibtex_reverse_field (BibtexField * field,
 	}
 
 	if (use_braces) {
-	    g_string_append (st, "@preamble{{");
+	    g_string_append_c (st, '{');
 	}
 	else {
-	    g_string_append (st, "@preamble{\"");
+	    g_string_append_c (st, '"');
 	}
 
 	if (do_quote) {
-	  tmp = recode_string (request, field->text);
-	  g_string_append (st, tmp);
-	  g_free (tmp);
+	  bibtex_latex_write (field->text, -1, st);
 	}
 	else {
 	  g_string_append (st, field->text);
 	}
 
 	if (use_braces) {
-	    g_string_append (st, "}}");
+	    g_string_append_c (st, '}');
 	}
 	else {
-	    g_string_append (st, "\"}");
+	    g_string_append_c (st, '"');
 	}
 
-	s = text_to_struct (st->str);
+	s = text_to_struct (st);
 	break;
 
     case BIBTEX_TITLE:
@@ -189,13 +325,13 @@ bibtex_reverse_field (BibtexField * field,
 	    }
 	}
 
-	tmp = recode_string (request, field->text);
+	tmp = bibtex_latex_string (field->text);
 
 	if (use_braces) {
-	    g_string_append (st, "@preamble{{");
+	    g_string_append_c (st, '{');
 	}
 	else {
-	    g_string_append (st, "@preamble{\"");
+	    g_string_append_c (st, '"');
 	}
 
 	/* Put the first lower case between {} */
@@ -280,13 +416,13 @@ bibtex_reverse_field (BibtexField * field,
 	g_free (string);
 
 	if (use_braces) {
-	    g_string_append (st, "}}");
+	    g_string_append_c (st, '}');
 	}
 	else {
-	    g_string_append (st, "\"}");
+	    g_string_append_c (st, '"');
 	}
 
-	s = text_to_struct (st->str);
+	s = text_to_struct (st);
 	break;
 
     case BIBTEX_AUTHOR:
@@ -294,10 +430,10 @@ bibtex_reverse_field (BibtexField * field,
 
 	g_string_truncate (st, 0);
 
-	/* Create a simple preamble to parse */
+	/* Create a simple value to parse */
 	if (! use_braces) {
 	    for (i = 0 ; i < field->field.author->len; i ++) {
-		author = & g_array_index (field->field.author, BibtexAuthor, i);
+		author = bibtex_author_group_get (field->field.author, i, & names);
 		
 		if (author->last && strchr (author->last, '"')) {
 		    use_braces = TRUE;
@@ -315,14 +451,14 @@ bibtex_reverse_field (BibtexField * field,
 	}
 	
 	if (use_braces) {
-	    g_string_append (st, "@preamble{{");
+	    g_string_append_c (st, '{');
 	}
 	else {
-	    g_string_append (st, "@preamble{\"");
+	    g_string_append_c (st, '"');
 	}
 
 	for (i = 0 ; i < field->field.author->len; i ++) {
-	    author = & g_array_index (field->field.author, BibtexAuthor, i);
+	    author = bibtex_author_group_get (field->field.author, i, & names);
 
 	    if (i != 0) {
 		g_string_append (st, " and ");
@@ -338,9 +474,7 @@ bibtex_reverse_field (BibtexField * field,
 		    g_string_append_c (st, '{');
 		}
 
-		tmp = recode_string (request, author->last);
-		g_string_append (st, tmp);
-		g_free (tmp);
+		bibtex_latex_write (author->last, -1, st);
 
 		if (has_space) {
 		    g_string_append_c (st, '}');
@@ -356,9 +490,7 @@ bibtex_reverse_field (BibtexField * field,
 		    g_string_append_c (st, '{');
 		}
 
-		tmp = recode_string (request, author->lineage);
-		g_string_append (st, tmp);
-		g_free (tmp);
+		bibtex_latex_write (author->lineage, -1, st);
 
 		if (has_space) {
 		    g_string_append_c (st, '}');
@@ -375,9 +507,7 @@ bibtex_reverse_field (BibtexField * field,
 		    g_string_append_c (st, '{');
 		}
 
-		tmp = recode_string (request, author->first);
-		g_string_append (st, tmp);
-		g_free (tmp);
+		bibtex_latex_write (author->first, -1, st);
 
 		if (has_space) {
 		    g_string_append_c (st, '}');
@@ -386,13 +516,13 @@ bibtex_reverse_field (BibtexField * field,
 	}
 
 	if (use_braces) {
-	    g_string_append (st, "}}");
+	    g_string_append_c (st, '}');
 	}
 	else {
-	    g_string_append (st, "\"}");
+	    g_string_append_c (st, '"');
 	}
 
-	s = text_to_struct (st->str);
+	s = text_to_struct (st);
 	break;
 
     case BIBTEX_DATE:
@@ -404,6 +534,8 @@ bibtex_reverse_field (BibtexField * field,
 	g_assert_not_reached ();
     }
 
+    g_string_free (st, TRUE);
+
     field->structure = s;
 
     /* remove text field */
@@ -416,3 +548,94 @@ bibtex_reverse_field (BibtexField * field,
 
     return field;
 }
+
+
+/* fewer fields are not worth a thread */
+#define BATCH_MIN_SIZE 256
+
+typedef struct {
+    BibtexField ** fields;
+    guint length;
+
+    /* the messages are emitted afterward, in the order of the fields */
+    GQueue * messages;
+}
+BibtexReverseBatch;
+
+typedef struct {
+    gboolean use_braces;
+    gboolean do_quote;
+}
+BibtexReverseJob;
+
+/* Thread pool callback: reverse the fields of a batch */
+static void
+reverse_batch (gpointer data,
+	       gpointer user) {
+    BibtexReverseBatch * batch = (BibtexReverseBatch *) data;
+    BibtexReverseJob   * job   = (BibtexReverseJob *) user;
+    guint i;
+
+    bibtex_messages_defer (batch->messages);
+
+    for (i = 0; i < batch->length; i ++) {
+	bibtex_reverse_field (batch->fields [i], job->use_braces, job->do_quote);
+    }
+
+    bibtex_messages_defer (NULL);
+}
+
+void
+bibtex_reverse_fields (GPtrArray * fields,
+		       gboolean use_braces,
+		       gboolean do_quote,
+		       gint threads) {
+    BibtexReverseBatch * batches;
+    BibtexReverseJob job;
+    GThreadPool * pool;
+    guint i, n, start, end;
+
+    g_return_if_fail (fields != NULL);
+
+    if (threads <= 0) {
+	threads = g_get_num_processors ();
+    }
+
+    n = MIN ((guint) threads, fields->len / BATCH_MIN_SIZE);
+
+    if (n <= 1) {
+	for (i = 0; i < fields->len; i ++) {
+	    bibtex_reverse_field (g_ptr_array_index (fields, i),
+				  use_braces, do_quote);
+	}
+	return;
+    }
+
+    job.use_braces = use_braces;
+    job.do_quote   = do_quote;
+
+    batches = g_new (BibtexReverseBatch, n);
+
+    pool = g_thread_pool_new (reverse_batch, & job, threads, FALSE, NULL);
+
+    for (i = 0; i < n; i ++) {
+	start = (i * fields->len) / n;
+	end   = ((i + 1) * fields->len) / n;
+
+	batches [i].fields   = (BibtexField **) fields->pdata + start;
+	batches [i].length   = end - start;
+	batches [i].messages = g_queue_new ();
+
+	g_thread_pool_push (pool, & batches [i], NULL);
+    }
+
+    /* wait for all the batches */
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+    for (i = 0; i < n; i ++) {
+	bibtex_messages_flush (batches [i].messages, TRUE);
+	g_queue_free (batches [i].messages);
+    }
+
+    g_free (batches);
+}
@@ -16,12 +16,16 @@ bibtex = [
     'biblex.c',
     'bibtex.c',
     'bibtexmodule.c',
+    'dict.c',
     'entry.c',
     'field.c',
+    'parallel.c',
+    'region.c',
     'reverse.c',
     'source.c',
     'stringutils.c',
-    'struct.c'
+    'struct.c',
+    'writer.c'
     ]
 
 
@@ -99,7 +103,7 @@ if rebuild ('bibparse.y', ['bibparse.c',
                            'bibparse.h']):
     print("rebuilding from bibparse.y")
 
-    os.system ('bison -y -d -t -p bibtex_parser_ bibparse.y')
+    os.system ('bison -d -t -p bibtex_parser_ -o y.tab.c bibparse.y')
 
     rename ('y.tab.c', 'bibparse.c')
     rename ('y.tab.h', 'bibparse.h')
@@ -206,7 +210,7 @@ It requires the following libraries to be installed:
               include_dirs = includes,
               library_dirs = libdirs,
               define_macros = [('G_LOG_DOMAIN', '"BibTeX"')],
-              libraries = libs + ['recode']),
+              libraries = libs),
 
     Extension("_recode", ["recodemodule.c"],
               include_dirs = includes,
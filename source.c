@@ -27,8 +27,45 @@
 #endif
 
 #include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include "bibtex.h"
 
+/* One rendering of a macro, chained with its other modes */
+typedef struct _BibtexExpansion BibtexExpansion;
+
+struct _BibtexExpansion {
+    guint mode;
+    gboolean loss;
+    gsize length;
+
+    BibtexExpansion * next;
+
+    gchar text [1];
+};
+
+static void
+free_expansions (gpointer data) {
+    BibtexExpansion * expansion = data, * next;
+
+    while (expansion) {
+	next = expansion->next;
+	g_free (expansion);
+	expansion = next;
+    }
+}
+
+static void
+free_users (gpointer key,
+	    gpointer value,
+	    gpointer user) {
+    g_ptr_array_free ((GPtrArray *) value, TRUE);
+}
+
 BibtexSource * 
 bibtex_source_new (void) {
     BibtexSource * new;
@@ -37,10 +74,22 @@ bibtex_source_new (void) {
 
     new->name  = NULL;
     new->type  = BIBTEX_SOURCE_NONE;
-    new->table = g_hash_table_new (g_str_hash, g_str_equal);
+    new->table = bibtex_dict_new ();
+    new->expansions = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					     NULL, free_expansions);
+    new->stamps = bibtex_dict_new ();
+    new->users  = bibtex_dict_new ();
+    new->serial = 0;
     new->debug = FALSE;
     new->buffer = NULL;
+    new->scanner = NULL;
+    new->strings = NULL;
+    new->region = NULL;
     new->strict = TRUE;
+    new->lazy = FALSE;
+    new->raw_fields = NULL;
+    new->raw_copies = NULL;
+    g_mutex_init (& new->raw_lock);
 
     return new;
 }
@@ -63,7 +112,13 @@ reset_source (BibtexSource * source) {
 	break;
 
     case BIBTEX_SOURCE_STRING:
-	g_free (source->source.string);
+	if (! source->source.string.borrowed) {
+	    g_free (source->source.string.text);
+	}
+	break;
+
+    case BIBTEX_SOURCE_MMAP:
+	munmap (source->source.map.data, source->source.map.length + 2);
 	break;
 
     default:
@@ -81,8 +136,6 @@ freedata (gpointer key,
 	   gpointer value, 
 	   gpointer user) {
 
-    g_free (key);
-
     if ((gboolean) GPOINTER_TO_INT(user)) {
 	bibtex_struct_destroy ((BibtexStruct *) value, TRUE);
     }
@@ -94,42 +147,221 @@ bibtex_source_get_string (BibtexSource * source,
     g_return_val_if_fail (source != NULL, NULL);
     g_return_val_if_fail (key != NULL, NULL);
 
-    return g_hash_table_lookup (source->table, key);
+    return bibtex_dict_lookup (source->table, key, -1);
+}
+
+/* Add or remove name from the users of the macros s refers to */
+static void
+link_users (BibtexSource * source,
+	    const gchar * name,
+	    BibtexStruct * s,
+	    gboolean add) {
+    GPtrArray * refs, * users;
+    const gchar * ref;
+    guint i, j;
+
+    refs = g_ptr_array_new ();
+    bibtex_struct_get_refs (s, refs);
+
+    for (i = 0; i < refs->len; i ++) {
+	ref   = g_ptr_array_index (refs, i);
+	users = bibtex_dict_lookup (source->users, ref, -1);
+
+	if (users == NULL) {
+	    if (! add) continue;
+
+	    users = g_ptr_array_new_with_free_func (g_free);
+	    bibtex_dict_insert (source->users, ref, -1, users);
+	}
+
+	for (j = 0; j < users->len; j ++) {
+	    if (g_ascii_strcasecmp (g_ptr_array_index (users, j), name) == 0) {
+		break;
+	    }
+	}
+
+	if (add && j == users->len) {
+	    g_ptr_array_add (users, g_strdup (name));
+	}
+	if (! add && j < users->len) {
+	    g_ptr_array_remove_index_fast (users, j);
+	}
+    }
+
+    g_ptr_array_free (refs, TRUE);
+}
+
+/* The macro has changed, and so have those using it */
+static void
+touch_macro (BibtexSource * source,
+	     const gchar * name) {
+    BibtexStruct * macro;
+    GPtrArray * users;
+    const gchar * user;
+    guint i;
+
+    bibtex_dict_insert (source->stamps, name, -1,
+			GUINT_TO_POINTER (source->serial));
+
+    macro = bibtex_dict_lookup (source->table, name, -1);
+
+    if (macro) {
+	g_hash_table_remove (source->expansions, macro);
+    }
+
+    users = bibtex_dict_lookup (source->users, name, -1);
+    if (users == NULL) return;
+
+    for (i = 0; i < users->len; i ++) {
+	user = g_ptr_array_index (users, i);
+
+	/* already done, macros might be defined in a loop */
+	if (bibtex_source_get_stamp (source, user) == source->serial) {
+	    continue;
+	}
+
+	touch_macro (source, user);
+    }
 }
 
 void
 bibtex_source_set_string (BibtexSource * source,
 			  gchar * key,
 			  BibtexStruct * value) {
-    gchar * inskey = key;
-    BibtexStruct * oldstruct = NULL;
+    BibtexStruct * oldstruct;
 
     g_return_if_fail (source != NULL);
     g_return_if_fail (key != NULL);
 
-    if ((oldstruct = g_hash_table_lookup (source->table, inskey)) == NULL) {
-	inskey = g_ascii_strdown(key, -1);
+    oldstruct = bibtex_dict_insert (source->table, key, -1, value);
+
+    if (oldstruct) {
+	link_users (source, key, oldstruct, FALSE);
+
+	g_hash_table_remove (source->expansions, oldstruct);
+	bibtex_struct_destroy (oldstruct, TRUE);
     }
-    else {
-	bibtex_struct_destroy(oldstruct, TRUE);
+
+    link_users (source, key, value, TRUE);
+
+    source->serial ++;
+    touch_macro (source, key);
+}
+
+guint
+bibtex_source_get_stamp (BibtexSource * source,
+			 const gchar * macro) {
+    g_return_val_if_fail (source != NULL, 0);
+    g_return_val_if_fail (macro != NULL, 0);
+
+    return GPOINTER_TO_UINT (bibtex_dict_lookup (source->stamps, macro, -1));
+}
+
+const gchar *
+bibtex_source_get_expansion (BibtexSource * source,
+			     BibtexStruct * macro,
+			     guint mode,
+			     gsize * length,
+			     gboolean * loss) {
+    BibtexExpansion * expansion;
+
+    g_return_val_if_fail (source != NULL, NULL);
+    g_return_val_if_fail (macro != NULL, NULL);
+
+    expansion = g_hash_table_lookup (source->expansions, macro);
+
+    while (expansion && expansion->mode != mode) {
+	expansion = expansion->next;
     }
 
-    g_hash_table_insert (source->table, inskey, value);
+    if (expansion == NULL) return NULL;
+
+    if (length) * length = expansion->length;
+    if (loss)   * loss   = expansion->loss;
+
+    return expansion->text;
+}
+
+void
+bibtex_source_set_expansion (BibtexSource * source,
+			     BibtexStruct * macro,
+			     guint mode,
+			     const gchar * text,
+			     gsize length,
+			     gboolean loss) {
+    BibtexExpansion * expansion;
+
+    g_return_if_fail (source != NULL);
+    g_return_if_fail (macro != NULL);
+
+    expansion = g_malloc (sizeof (BibtexExpansion) + length);
+
+    expansion->mode   = mode;
+    expansion->loss   = loss;
+    expansion->length = length;
+
+    memcpy (expansion->text, text, length);
+    expansion->text [length] = '\0';
+
+    /* the table owns the chain through its first link */
+    expansion->next = g_hash_table_lookup (source->expansions, macro);
+    g_hash_table_steal (source->expansions, macro);
+    g_hash_table_insert (source->expansions, macro, expansion);
 }
 
 void           
 bibtex_source_destroy (BibtexSource * source,
 		       gboolean free_data) {
+    BibtexField * field;
+
     g_return_if_fail (source != NULL);
 
-    g_hash_table_foreach (source->table, freedata, GINT_TO_POINTER(free_data));
-    g_hash_table_destroy (source->table);
+    /* the lazy fields left no longer belong anywhere */
+    g_mutex_lock (& source->raw_lock);
+    while ((field = source->raw_fields) != NULL) {
+	source->raw_fields = field->raw_next;
+
+	field->raw_source = NULL;
+	field->raw_prev   = field->raw_next = NULL;
+    }
+    g_mutex_unlock (& source->raw_lock);
+
+    bibtex_dict_foreach (source->table, freedata, GINT_TO_POINTER(free_data));
+    bibtex_dict_destroy (source->table);
+    g_hash_table_destroy (source->expansions);
+    bibtex_dict_destroy (source->stamps);
+    bibtex_dict_foreach (source->users, free_users, NULL);
+    bibtex_dict_destroy (source->users);
 
     reset_source (source);
 
+    if (source->strings) {
+	g_string_chunk_free (source->strings);
+    }
+
+    if (source->raw_copies) {
+	g_string_chunk_free (source->raw_copies);
+    }
+
+    g_mutex_clear (& source->raw_lock);
+
+    /* last, as the table might still refer to it */
+    if (source->region) {
+	bibtex_region_destroy (source->region);
+    }
+
     g_free (source);
 }
 
+void
+bibtex_source_use_region (BibtexSource * source) {
+    g_return_if_fail (source != NULL);
+
+    if (source->region == NULL) {
+	source->region = bibtex_region_new ();
+    }
+}
+
 
 gboolean
 bibtex_source_file (BibtexSource * source, 
@@ -159,12 +391,178 @@ bibtex_source_file (BibtexSource * source,
 }
 
 
+/* Map the file, followed by two NUL bytes; NULL on error */
+static gchar *
+map_file (const gchar * filename,
+	  gsize * size) {
+    int fd;
+    struct stat info;
+    gchar * data;
+    gsize length;
+
+    fd = open (filename, O_RDONLY);
+    if (fd == -1) {
+	bibtex_error ("can't open file `%s': %s",
+		      filename,
+		      g_strerror (errno));
+	return NULL;
+    }
+
+    if (fstat (fd, & info) == -1) {
+	bibtex_error ("can't stat file `%s': %s",
+		      filename,
+		      g_strerror (errno));
+	close (fd);
+	return NULL;
+    }
+
+    length = info.st_size;
+
+    /* 
+       The scanner needs two NUL bytes after the text, and writes
+       into its buffer while tokenizing. So we reserve a zeroed
+       private area two bytes larger than the file, and map the file
+       privately over its beginning.
+    */
+    data = mmap (NULL, length + 2, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (data != MAP_FAILED && length > 0 &&
+	mmap (data, length, PROT_READ | PROT_WRITE,
+	      MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+	munmap (data, length + 2);
+	data = MAP_FAILED;
+    }
+
+    if (data == MAP_FAILED) {
+	bibtex_error ("can't map file `%s': %s",
+		      filename,
+		      g_strerror (errno));
+	close (fd);
+	return NULL;
+    }
+
+    /* the mapping remains valid once the descriptor is closed */
+    close (fd);
+
+    * size = length;
+
+    return data;
+}
+
+gboolean
+bibtex_source_mmap (BibtexSource * source, 
+		    gchar * filename) {
+    gchar * data;
+    gsize length;
+
+    g_return_val_if_fail (source != NULL, FALSE);
+    g_return_val_if_fail (filename != NULL, FALSE);
+    
+    data = map_file (filename, & length);
+    if (data == NULL) return FALSE;
+
+    reset_source (source);
+
+    source->type = BIBTEX_SOURCE_MMAP;
+    source->name = g_strdup (filename);
+    source->source.map.data   = data;
+    source->source.map.length = length;
+    
+    bibtex_analyzer_initialize (source);
+
+    return TRUE;
+}
+
+/* Is the text of a lazy field, at least partly, in that part of data ? */
+static gboolean
+raw_in (BibtexField * field,
+	const gchar * data,
+	gint offset,
+	gint length) {
+    return (field->raw + field->raw_length > data + offset &&
+	    field->raw < data + offset + length);
+}
+
+void
+bibtex_source_copy_raw (BibtexSource * source,
+			gint offset,
+			gint length) {
+    BibtexField * field;
+    const gchar * data;
+
+    g_return_if_fail (source != NULL);
+    g_return_if_fail (source->type == BIBTEX_SOURCE_MMAP);
+
+    data = source->source.map.data;
+
+    /* the text about to be replaced is the only one copied */
+    for (field = source->raw_fields; field; field = field->raw_next) {
+	if (! raw_in (field, data, offset, length)) continue;
+
+	if (source->raw_copies == NULL) {
+	    source->raw_copies = g_string_chunk_new (4096);
+	}
+
+	field->raw = g_string_chunk_insert_len (source->raw_copies,
+						field->raw,
+						field->raw_length);
+    }
+}
+
 gboolean
-bibtex_source_string (BibtexSource * source, 
-		      gchar * name,
-		      gchar * string) {
+bibtex_source_remap (BibtexSource * source,
+		     gint offset,
+		     gint length,
+		     gint shift) {
+    BibtexField * field;
+    gchar * data, * old;
+    gsize size, old_size;
+
     g_return_val_if_fail (source != NULL, FALSE);
-    g_return_val_if_fail (string != NULL, FALSE);
+    g_return_val_if_fail (source->type == BIBTEX_SOURCE_MMAP, FALSE);
+
+    data = map_file (source->name, & size);
+    if (data == NULL) return FALSE;
+
+    old      = source->source.map.data;
+    old_size = source->source.map.length;
+
+    /* 
+       Lazy fields follow their text in the new mapping: before the
+       replaced part it did not move, after it, it moved by shift.
+       Those in the replaced part have a copy already.
+    */
+    for (field = source->raw_fields; field; field = field->raw_next) {
+	if (! raw_in (field, old, 0, old_size)) continue;
+
+	if (field->raw < old + offset) {
+	    field->raw = data + (field->raw - old);
+	}
+	else {
+	    field->raw = data + (field->raw - old) + shift;
+	}
+    }
+
+    source->source.map.data   = data;
+    source->source.map.length = size;
+
+    bibtex_analyzer_initialize (source);
+
+    /* nothing points in the previous mapping any more */
+    munmap (old, old_size + 2);
+
+    return TRUE;
+}
+
+
+static void
+set_string (BibtexSource * source, 
+	    gchar * name,
+	    gchar * text,
+	    gsize length,
+	    gboolean borrowed,
+	    gboolean in_place) {
 
     reset_source (source);
 
@@ -177,9 +575,49 @@ bibtex_source_string (BibtexSource * source,
 	source->name = g_strdup ("<string>");
     }
 
-    source->source.string = g_strdup (string);
+    source->source.string.text     = text;
+    source->source.string.length   = length;
+    source->source.string.borrowed = borrowed;
+    source->source.string.in_place = in_place;
     
     bibtex_analyzer_initialize (source);
+}
+
+gboolean
+bibtex_source_string (BibtexSource * source, 
+		      gchar * name,
+		      gchar * string) {
+    g_return_val_if_fail (source != NULL, FALSE);
+    g_return_val_if_fail (string != NULL, FALSE);
+
+    set_string (source, name, g_strdup (string), strlen (string), 
+		FALSE, FALSE);
+
+    return TRUE;
+}
+
+gboolean
+bibtex_source_buffer (BibtexSource * source, 
+		      gchar * name,
+		      const gchar * text,
+		      gsize length) {
+    g_return_val_if_fail (source != NULL, FALSE);
+    g_return_val_if_fail (text != NULL, FALSE);
+
+    set_string (source, name, (gchar *) text, length, TRUE, FALSE);
+
+    return TRUE;
+}
+
+gboolean
+bibtex_source_scan (BibtexSource * source, 
+		    gchar * name,
+		    gchar * text,
+		    gsize length) {
+    g_return_val_if_fail (source != NULL, FALSE);
+    g_return_val_if_fail (text != NULL, FALSE);
+
+    set_string (source, name, text, length, TRUE, TRUE);
 
     return TRUE;
 }
@@ -202,6 +640,26 @@ bibtex_source_set_offset (BibtexSource * file,
 			  gint offset) {
     g_return_if_fail (file != NULL);
 
+    if (file->type == BIBTEX_SOURCE_MMAP || 
+	file->type == BIBTEX_SOURCE_STRING) {
+	gsize length = (file->type == BIBTEX_SOURCE_MMAP) ?
+	    file->source.map.length : file->source.string.length;
+
+	if (offset < 0 || (gsize) offset > length) {
+	    bibtex_error ("%s: can't jump to offset %d: out of range", 
+			  file->name, offset);
+	    file->error = TRUE;
+	    return;
+	}
+
+	/* no need to restart the scanner, simply move inside the buffer */
+	bibtex_analyzer_seek (file, offset);
+
+	file->offset = offset;
+	file->eof    = file->error = FALSE;
+	return;
+    }
+
     bibtex_analyzer_finish (file);
 
     switch (file->type) {
@@ -215,12 +673,12 @@ bibtex_source_set_offset (BibtexSource * file,
 	}
 	break;
 
-    case BIBTEX_SOURCE_STRING:
-	break;
-
     case BIBTEX_SOURCE_NONE:
 	g_warning ("no source to set offset");
 	break;
+
+    default:
+	g_assert_not_reached ();
     }
 
     file->offset = offset;
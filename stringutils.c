@@ -27,25 +27,25 @@
 
 #include "bibtex.h"
 
-static GList * strings = NULL;
-
+/* 
+   Copy a string until the end of the current entry. All the copies
+   are released at once.
+*/
 gchar *
-bibtex_tmp_string (gchar * string) {
-    strings = g_list_append (strings, string);
-    return string;
+bibtex_tmp_string (BibtexSource * source, 
+		   const gchar * text,
+		   gsize length) {
+    if (source->strings == NULL) {
+	source->strings = g_string_chunk_new (1024);
+    }
+
+    return g_string_chunk_insert_len (source->strings, text, length);
 }
 
 void 
-bibtex_tmp_string_free (void) {
-    GList * tmp = strings;
-    
-    while (tmp) {
-	g_free (tmp->data);
-	tmp = tmp->next;
+bibtex_tmp_string_free (BibtexSource * source) {
+    if (source->strings) {
+	g_string_chunk_clear (source->strings);
     }
-
-    g_list_free (strings);
-    
-    strings = NULL;
 }
 
@@ -25,20 +25,94 @@
 #include "config.h"
 #endif
 
+#include <string.h>
 #include <strings.h>
 #include <ctype.h>
 
 #include "bibtex.h"
 
+/* 
+   The children of a list node are kept in a single array. While a
+   source using a region is parsed, new nodes, their text and these
+   arrays are allocated in that region.
+*/
+#define LIST_SIZE(n) (sizeof (BibtexStructList) + (n) * sizeof (BibtexStruct *))
+
+static BibtexStructList *
+list_new (guint allocated) {
+    BibtexStructList * list = bibtex_alloc (LIST_SIZE (allocated));
+
+    list->length    = 0;
+    list->allocated = allocated;
+
+    return list;
+}
+
+static void
+list_release (BibtexStruct * s, BibtexStructList * list) {
+    if (! s->in_region) {
+	g_free (list);
+    }
+}
+
+/* Make room for more children in the list of s */
+static BibtexStructList *
+list_reserve (BibtexStruct * s, guint more) {
+    BibtexStructList * list = s->value.list, * grown;
+    guint allocated;
+
+    if (list->length + more <= list->allocated) {
+	return list;
+    }
+
+    allocated = MAX (2 * list->allocated, list->length + more);
+
+    if (s->in_region) {
+	/* the old array simply stays in the region */
+	grown = list_new (allocated);
+	grown->length = list->length;
+
+	memcpy (grown->items, list->items, 
+		list->length * sizeof (BibtexStruct *));
+    }
+    else {
+	grown = g_realloc (list, LIST_SIZE (allocated));
+	grown->allocated = allocated;
+    }
+
+    s->value.list = grown;
+
+    return grown;
+}
+
+static void
+list_append (BibtexStruct * s, BibtexStruct * child) {
+    BibtexStructList * list = list_reserve (s, 1);
+
+    list->items [list->length ++] = child;
+}
+
+static void
+list_prepend (BibtexStruct * s, BibtexStruct * child) {
+    BibtexStructList * list = list_reserve (s, 1);
+
+    memmove (list->items + 1, list->items, 
+	     list->length * sizeof (BibtexStruct *));
+
+    list->items [0] = child;
+    list->length ++;
+}
+
 BibtexStruct *
 bibtex_struct_new (BibtexStructType type) {
-    BibtexStruct * s = g_new (BibtexStruct, 1);
+    BibtexStruct * s = bibtex_alloc (sizeof (BibtexStruct));
 
     s->type = type;
+    s->in_region = (bibtex_region_current () != NULL);
 
     switch (type) {
     case BIBTEX_STRUCT_LIST:
-	s->value.list = NULL;
+	s->value.list = list_new (4);
 	break;
     case BIBTEX_STRUCT_TEXT:
 	s->value.text = NULL;
@@ -50,7 +124,7 @@ bibtex_struct_new (BibtexStructType type) {
 	s->value.com = NULL;
 	break;
     case BIBTEX_STRUCT_SUB:
-	s->value.sub = g_new (BibtexStructSub, 1);
+	s->value.sub = bibtex_alloc (sizeof (BibtexStructSub));
 	s->value.sub->content = NULL;
 	s->value.sub->encloser = BIBTEX_ENCLOSER_BRACE;
 	break;
@@ -68,10 +142,13 @@ bibtex_struct_new (BibtexStructType type) {
 void
 bibtex_struct_destroy (BibtexStruct * s,
 		       gboolean remove_content) {
-    GList * current;
+    guint i;
 
     g_return_if_fail (s != NULL);
 
+    /* released along with its region */
+    if (s->in_region) return;
+
     switch (s->type) {
     case BIBTEX_STRUCT_TEXT:
 	if (remove_content)
@@ -90,15 +167,13 @@ bibtex_struct_destroy (BibtexStruct * s,
 
     case BIBTEX_STRUCT_LIST:
 	if (remove_content) {
-	    current = s->value.list;
-	    while (current) {
-		bibtex_struct_destroy ((BibtexStruct *) current->data,
+	    for (i = 0; i < s->value.list->length; i ++) {
+		bibtex_struct_destroy (s->value.list->items [i],
 				       remove_content);
-		current = current->next;
 	    }
 	}
 
-	g_list_free (s->value.list);
+	list_release (s, s->value.list);
 	break;
 
     case BIBTEX_STRUCT_SUB:
@@ -123,7 +198,7 @@ bibtex_struct_destroy (BibtexStruct * s,
 
 void
 bibtex_struct_display (BibtexStruct * source) {
-    GList * list;
+    guint i;
 
     g_return_if_fail (source != NULL);
 
@@ -149,10 +224,8 @@ bibtex_struct_display (BibtexStruct * source) {
 
     case BIBTEX_STRUCT_LIST:
 	printf ("List(");
-	list = source->value.list;
-	while (list) {
-	    bibtex_struct_display ((BibtexStruct *) list->data);
-	    list = list->next;
+	for (i = 0; i < source->value.list->length; i ++) {
+	    bibtex_struct_display (source->value.list->items [i]);
 	}
 	printf (")\n");
 	break;
@@ -170,7 +243,7 @@ bibtex_struct_display (BibtexStruct * source) {
 BibtexStruct *
 bibtex_struct_copy (BibtexStruct * source) {
     BibtexStruct * target;
-    GList * list;
+    guint i;
 
     g_return_val_if_fail (source != NULL, NULL);
 
@@ -196,13 +269,11 @@ bibtex_struct_copy (BibtexStruct * source) {
 	break;
 
     case BIBTEX_STRUCT_LIST:
-	list = source->value.list;
-	while (list) {
-	    target->value.list = 
-		g_list_append (target->value.list,
-			       bibtex_struct_copy ((BibtexStruct *)
-						   list->data));
-	    list = list->next;
+	list_reserve (target, source->value.list->length);
+
+	for (i = 0; i < source->value.list->length; i ++) {
+	    list_append (target, 
+			 bibtex_struct_copy (source->value.list->items [i]));
 	}
 	break;
 
@@ -234,11 +305,20 @@ bibtex_struct_append (BibtexStruct * s1,
 
 	/* Fusion de deux bouts de texte */
 
-	tmp = s1->value.text;
-	s1->value.text = g_strconcat (s1->value.text,
-				      s2->value.text,
-				      NULL);
-	g_free (tmp);
+	tmp = g_strconcat (s1->value.text,
+			   s2->value.text,
+			   NULL);
+
+	if (s1->in_region) {
+	    /* the old text simply stays in the region */
+	    s1->value.text = bibtex_strndup (tmp, -1);
+	    g_free (tmp);
+	}
+	else {
+	    g_free (s1->value.text);
+	    s1->value.text = tmp;
+	}
+
 	bibtex_struct_destroy (s2, TRUE);
 	return (s1);
     }
@@ -248,8 +328,13 @@ bibtex_struct_append (BibtexStruct * s1,
 
 	/* Fusion de deux listes simples */
 
-	s1->value.list = g_list_concat (s1->value.list, 
-					s2->value.list);
+	list_reserve (s1, s2->value.list->length);
+
+	memcpy (s1->value.list->items + s1->value.list->length,
+		s2->value.list->items, 
+		s2->value.list->length * sizeof (BibtexStruct *));
+	s1->value.list->length += s2->value.list->length;
+
 	bibtex_struct_destroy (s2, FALSE);
 	return (s1);
     }
@@ -257,13 +342,13 @@ bibtex_struct_append (BibtexStruct * s1,
     /* One or the other is a list... */
     if (s1->type == BIBTEX_STRUCT_LIST) {
 	/* append the second to the first... */
-	s1->value.list = g_list_append (s1->value.list, s2);
+	list_append (s1, s2);
 	return (s1);
     }
 
     if (s2->type == BIBTEX_STRUCT_LIST) {
 	/* append the second to the first... */
-	s2->value.list = g_list_prepend (s2->value.list, s1);
+	list_prepend (s2, s1);
 	return (s2);
     }
 
@@ -271,17 +356,27 @@ bibtex_struct_append (BibtexStruct * s1,
        deux elements passes en entree */
     
     ret = bibtex_struct_new (BIBTEX_STRUCT_LIST);
-    ret->value.list = g_list_append (ret->value.list, s1);
-    ret->value.list = g_list_append (ret->value.list, s2);
+    list_append (ret, s1);
+    list_append (ret, s2);
 
     return ret;
 }
 
 
-static gchar *
+/* everything the rendering of a macro depends upon */
+#define EXPANSION_MODE(type, as_bibtex, level, at_beginning, strip, as_latex) \
+    ((type) | (MIN ((level), 2) << 3) | ((!! (as_bibtex)) << 5) |	\
+     ((!! (at_beginning)) << 6) | ((!! (strip)) << 7) | ((!! (as_latex)) << 8))
+
+/* 
+   Render s at the end of out. Every renderer goes through here, in a
+   single traversal, without intermediate strings.
+*/
+static void
 bibtex_real_string (BibtexStruct * s,
+		    GString * out,
 		    BibtexFieldType type,
-		    GHashTable * dico,
+		    BibtexSource * source,
 		    gboolean as_bibtex,
 		    gint level,
 		    gboolean * loss,
@@ -289,165 +384,177 @@ bibtex_real_string (BibtexStruct * s,
 		    gboolean strip_first_layer,
 		    gboolean as_latex) {
 
-    gchar * text = NULL, * tmp;
-    GList * list;
+    const gchar * text;
+    BibtexStructFlow flow;
     BibtexStruct * tmp_s;
-    gboolean first;
-    GString * string;
+    gboolean first, macro_loss;
+    gsize start, length, i;
+    guint mode;
 
-    g_return_val_if_fail (s != NULL, NULL);
+    g_return_if_fail (s != NULL);
 
     switch (s->type) {
 
     case BIBTEX_STRUCT_SPACE:
 	if (as_bibtex || type == BIBTEX_VERBATIM) {
-	    if (s->value.unbreakable) {
-		text = g_strdup ("~");
-	    } 
-	    else {
-		text = g_strdup (" ");
-	    }
+	    g_string_append_c (out, s->value.unbreakable ? '~' : ' ');
 	}
 	else {
 	    /* unbreakable spaces are lost */
 	    if (s->value.unbreakable) {
 		if (loss) * loss = TRUE;
 	    }
-	    text = g_strdup (" ");
+	    g_string_append_c (out, ' ');
 	}
 	break;
 
     case BIBTEX_STRUCT_COMMAND:
 	if (as_bibtex) {
-	    text = g_strconcat ("\\", s->value.com, NULL);
+	    g_string_append_c (out, '\\');
+	    g_string_append (out, s->value.com);
 	}
 	else {
-	    text = bibtex_accent_string (s, NULL, loss);
+	    bibtex_accent_write (s, NULL, out, loss);
 	}
 	break;
 	
     case BIBTEX_STRUCT_TEXT:
+	start = out->len;
+	g_string_append (out, s->value.text);
 
 	if ((! as_bibtex || as_latex) && 
 	    level == 1 && 
 	    type == BIBTEX_TITLE) {
-	    text = g_ascii_strdown(s->value.text, -1);
-	    if (at_beginning) {
-		text [0] = toupper(text[0]);
+
+	    for (i = start; i < out->len; i ++) {
+		out->str [i] = g_ascii_tolower (out->str [i]);
+	    }
+
+	    if (at_beginning && start < out->len) {
+		out->str [start] = toupper (out->str [start]);
 	    }
-	} else {
-  	    text = g_strdup(s->value.text);
 	}
 	break;
 
     case BIBTEX_STRUCT_REF:
 	if (as_bibtex && ! as_latex) {
-	    text = g_ascii_strdown(s->value.ref, -1);
+	    start = out->len;
+	    g_string_append (out, s->value.ref);
+
+	    for (i = start; i < out->len; i ++) {
+		out->str [i] = g_ascii_tolower (out->str [i]);
+	    }
 	}
 	else {
 	    if (loss) * loss = TRUE;
 
-	    if (dico) {
-	        tmp = g_ascii_strdown(s->value.ref, -1);
-		tmp_s = (BibtexStruct *) g_hash_table_lookup(dico, tmp);
-		g_free(tmp);
+	    if (source) {
+		tmp_s = bibtex_source_get_string (source, s->value.ref);
 
 		if (tmp_s) {
-		    text = bibtex_real_string (tmp_s, type, 
-					       dico, 
-					       as_bibtex,
-					       level, loss, at_beginning,
-					       strip_first_layer, as_latex);
+		    /* a macro is rendered once for each way it is used */
+		    mode = EXPANSION_MODE (type, as_bibtex, level, at_beginning,
+					   strip_first_layer, as_latex);
+
+		    text = bibtex_source_get_expansion (source, tmp_s, mode,
+							& length, & macro_loss);
+
+		    if (text) {
+			g_string_append_len (out, text, length);
+		    }
+		    else {
+			start = out->len;
+			macro_loss = FALSE;
+
+			bibtex_real_string (tmp_s, out, type, 
+					    source, 
+					    as_bibtex,
+					    level, & macro_loss, at_beginning,
+					    strip_first_layer, as_latex);
+
+			bibtex_source_set_expansion (source, tmp_s, mode,
+						     out->str + start, 
+						     out->len - start,
+						     macro_loss);
+		    }
+
+		    if (loss && macro_loss) * loss = TRUE;
 		}
 		else {
 		    bibtex_warning ("reference `%s' undefined", s->value.text);
-		    text = g_strdup ("<undefined>");
+		    g_string_append (out, "<undefined>");
 		}
 	    }
 	    else {
-		text = g_strdup ("<undefined>");
+		g_string_append (out, "<undefined>");
 	    }
 	}
 	break;
 
     case BIBTEX_STRUCT_LIST:
-	string = g_string_new ("");
-
-	list = s->value.list;
+	flow.next = s->value.list->items;
+	flow.end  = flow.next + s->value.list->length;
 	first = TRUE;
 
-	while (list != NULL) {
-	    tmp_s = (BibtexStruct *) list->data;
-
-	    list = list->next;
+	while (flow.next < flow.end) {
+	    tmp_s = * (flow.next ++);
 
 	    if (! as_bibtex &&
 		tmp_s->type == BIBTEX_STRUCT_COMMAND) {
 
 		/* Passer a la fonction le flot suivant */
-		tmp = bibtex_accent_string (tmp_s, & list, loss);
-		g_string_append (string, tmp);
-		g_free (tmp);
+		bibtex_accent_write (tmp_s, & flow, out, loss);
 	    }
 	    else {
 		if (level == 0 && as_bibtex && ! first && ! as_latex) {
-		    g_string_append (string, " # ");
+		    g_string_append (out, " # ");
 		}
-		tmp = bibtex_real_string(tmp_s, type, dico, as_bibtex, level,
-					 loss, at_beginning && first, 
-					 strip_first_layer, as_latex);
-
-		g_string_append(string, tmp);
-		g_free(tmp);
+		bibtex_real_string (tmp_s, out, type, source, as_bibtex, level,
+				    loss, at_beginning && first, 
+				    strip_first_layer, as_latex);
 	    }
 
 	    first = FALSE;
 	}
-
-	text = string->str;
-	g_string_free (string, FALSE);
 	break;
 	
     case BIBTEX_STRUCT_SUB:
 	if (as_bibtex) {
-	    tmp = bibtex_real_string (s->value.sub->content,
-				      type, dico, 
-				      as_bibtex,
-				      /* climb one level if we are in pure
-					 bibtex, or if we are in latex and {} */
-				      level + 1,
-				      loss, at_beginning, FALSE, as_latex);
-
-	    if (strip_first_layer) {
-		text = tmp;
-	    }
-	    else {
-		/* As bibtex, add the encloser */
+	    /* As bibtex, add the encloser */
+	    if (! strip_first_layer) {
 		switch (s->value.sub->encloser) {
-		    
 		case BIBTEX_ENCLOSER_BRACE:
-		    text = g_strdup_printf ("{%s}", tmp);
+		    g_string_append_c (out, '{');
 		    break;
-		    
 		case BIBTEX_ENCLOSER_QUOTE:
-		    text = g_strdup_printf ("\"%s\"", tmp);
+		    g_string_append_c (out, '"');
 		    break;
-		
 		default:
 		    g_assert_not_reached ();
 		    break;
 		}
-		
-		g_free (tmp);
+	    }
+
+	    bibtex_real_string (s->value.sub->content, out,
+				type, source, 
+				as_bibtex,
+				/* climb one level if we are in pure
+				   bibtex, or if we are in latex and {} */
+				level + 1,
+				loss, at_beginning, FALSE, as_latex);
+
+	    if (! strip_first_layer) {
+		g_string_append_c (out, (s->value.sub->encloser == 
+					 BIBTEX_ENCLOSER_BRACE) ? '}' : '"');
 	    }
 	}
 	else {
 	    /* As simple text, add nothing. */
-	    text = bibtex_real_string (s->value.sub->content,
-				       type, dico,
-				       as_bibtex,
-				       level + 1,
-				       loss, at_beginning, FALSE, as_latex);
+	    bibtex_real_string (s->value.sub->content, out,
+				type, source,
+				as_bibtex,
+				level + 1,
+				loss, at_beginning, FALSE, as_latex);
 	}
 	break;
 
@@ -455,57 +562,45 @@ bibtex_real_string (BibtexStruct * s,
 	g_assert_not_reached ();
 	break;
     }
+}
+
+/* Append the children of list to s, with those of the inner lists */
+static void
+flatten_into (BibtexStruct * s, BibtexStructList * list) {
+    BibtexStruct * tmp_s;
+    guint i;
 
+    for (i = 0; i < list->length; i ++) {
+	tmp_s = list->items [i];
 
-    return text;
+	/* Si on trouve une liste dans la liste... */
+	if (tmp_s->type == BIBTEX_STRUCT_LIST) {
+	    /* Incorporer tous les elements de la deuxieme liste */
+	    flatten_into (s, tmp_s->value.list);
+
+	    /* ...et detruire l'ancien element */
+	    bibtex_struct_destroy (tmp_s, FALSE);
+	}
+	else {
+	    list_append (s, bibtex_struct_flatten (tmp_s));
+	}
+    }
 }
 
 BibtexStruct * 
 bibtex_struct_flatten (BibtexStruct * s) {
-    GList * list, * newlist, * tmp;
-    BibtexStruct * tmp_s;
-    gboolean stable;
+    BibtexStructList * list;
 
     g_return_val_if_fail (s != NULL, NULL);
 
     switch (s->type) {
     case BIBTEX_STRUCT_LIST:
-	/* Aplanir une liste */
-	stable = FALSE;
-
-	while (! stable) {
-	    stable = TRUE;
-	    list = s->value.list;
-	    
-	    newlist = NULL;
-	    while (list) {
-		tmp_s = (BibtexStruct *) list->data;
-		
-		/* Si on trouve une liste dans la liste... */
-		if (tmp_s->type == BIBTEX_STRUCT_LIST) {
-		    /* Il faudra repasser un coup apres... */
-		    stable = FALSE;
-		    tmp = tmp_s->value.list;
-
-		    /* Incorporer tous les elements de la deuxieme liste */
-		    while (tmp) {
-			newlist = g_list_append (newlist, tmp->data);
-			tmp = tmp->next;
-		    }
-		    /* ...et detruire l'ancien element */
-		    bibtex_struct_destroy (tmp_s, FALSE);
-		}
-		else {
-		    newlist = g_list_append (newlist, 
-					     bibtex_struct_flatten (tmp_s));
-		}
-		
-		list = list->next;
-	    }
-	    g_list_free (s->value.list);
-	    s->value.list = newlist;
-	}
+	/* Aplanir une liste, en une seule passe */
+	list = s->value.list;
+	s->value.list = list_new (list->length);
 
+	flatten_into (s, list);
+	list_release (s, list);
 	break;
 
     case BIBTEX_STRUCT_SUB:
@@ -520,31 +615,112 @@ bibtex_struct_flatten (BibtexStruct * s) {
     return s;
 }
 
+void
+bibtex_struct_get_refs (BibtexStruct * s,
+			GPtrArray * refs) {
+    guint i;
+
+    g_return_if_fail (s != NULL);
+    g_return_if_fail (refs != NULL);
+
+    switch (s->type) {
+    case BIBTEX_STRUCT_REF:
+	/* macro names are not case sensitive */
+	for (i = 0; i < refs->len; i ++) {
+	    if (g_ascii_strcasecmp (g_ptr_array_index (refs, i),
+				    s->value.ref) == 0) return;
+	}
+
+	g_ptr_array_add (refs, s->value.ref);
+	break;
+
+    case BIBTEX_STRUCT_LIST:
+	for (i = 0; i < s->value.list->length; i ++) {
+	    bibtex_struct_get_refs (s->value.list->items [i], refs);
+	}
+	break;
+
+    case BIBTEX_STRUCT_SUB:
+	bibtex_struct_get_refs (s->value.sub->content, refs);
+	break;
+
+    default:
+	break;
+    }
+}
+
+void
+bibtex_struct_write_string (BibtexStruct * s,
+			    GString * buffer,
+			    BibtexFieldType type,
+			    BibtexSource * source,
+			    gboolean * loss) {
+    g_return_if_fail (s != NULL);
+    g_return_if_fail (buffer != NULL);
+
+    bibtex_real_string (s, buffer, type, source, FALSE, 0, loss, TRUE, 
+			FALSE, FALSE);
+}
+
+void
+bibtex_struct_write_bibtex (BibtexStruct * s,
+			    GString * buffer) {
+    g_return_if_fail (s != NULL);
+    g_return_if_fail (buffer != NULL);
+
+    bibtex_real_string (s, buffer, BIBTEX_OTHER, NULL, TRUE, 0, NULL, TRUE,
+			FALSE, FALSE);
+}
+
+void
+bibtex_struct_write_latex (BibtexStruct * s,
+			   GString * buffer,
+			   BibtexFieldType type,
+			   BibtexSource * source) {
+    g_return_if_fail (s != NULL);
+    g_return_if_fail (buffer != NULL);
+
+    bibtex_real_string (s, buffer, type, source, TRUE, 0, NULL, TRUE,
+			TRUE, TRUE);
+}
+
 gchar * 
 bibtex_struct_as_string (BibtexStruct * s,
 			 BibtexFieldType type,
-			 GHashTable * dico,
+			 BibtexSource * source,
 			 gboolean * loss) {
+    GString * buffer;
+
     g_return_val_if_fail (s != NULL, NULL);
 
-    return bibtex_real_string (s, type, dico, FALSE, 0, loss, TRUE, 
-			       FALSE, FALSE);
+    buffer = g_string_new (NULL);
+    bibtex_struct_write_string (s, buffer, type, source, loss);
+
+    return g_string_free (buffer, FALSE);
 }
 
 gchar * 
 bibtex_struct_as_bibtex (BibtexStruct * s) {
+    GString * buffer;
+
     g_return_val_if_fail (s != NULL, NULL);
 
-    return bibtex_real_string (s, BIBTEX_OTHER, NULL, TRUE, 0, NULL, TRUE,
-			       FALSE, FALSE);
+    buffer = g_string_new (NULL);
+    bibtex_struct_write_bibtex (s, buffer);
+
+    return g_string_free (buffer, FALSE);
 }
 
 gchar * 
 bibtex_struct_as_latex (BibtexStruct * s,
 			BibtexFieldType type,
-			GHashTable * dico) {
+			BibtexSource * source) {
+    GString * buffer;
+
     g_return_val_if_fail (s != NULL, NULL);
 
-    return bibtex_real_string (s, type, dico, TRUE, 0, NULL, TRUE,
-			       TRUE, TRUE);
+    buffer = g_string_new (NULL);
+    bibtex_struct_write_latex (s, buffer, type, source);
+
+    return g_string_free (buffer, FALSE);
 }
@@ -37,7 +37,8 @@ def check_bibtex ():
     import _bibtex
 
 
-    def checkfile (filename, strict = 1, typemap = {}):
+    def checkfile (filename, strict = 1, typemap = {},
+                   opener = _bibtex.open_file):
         
         def expand (file, entry, type = -1):
             """Inline the expanded respresentation of each field."""
@@ -47,7 +48,7 @@ def check_bibtex ():
                 results.append((k, _bibtex.expand (file, items [k], typemap.get (k, -1))))
             return (bibkey, bibtype, a, b, results)
         
-        file   = _bibtex.open_file (filename, strict)
+        file   = opener (filename, strict)
         result = open (filename + '-ok', 'r')
 
         line     = 1
@@ -85,7 +86,7 @@ def check_bibtex ():
                 
         return failures, checks
 
-    def checkunfiltered (filename, strict = 1):
+    def checkunfiltered (filename, strict = 1, opener = _bibtex.open_file):
         
         def expand (file, entry):
             if entry[0] in ('preamble', 'string'):
@@ -97,7 +98,7 @@ def check_bibtex ():
                        for k in sorted(items)]
             return (bibkind, (bibkey, bibtype, a, b, results))
         
-        file   = _bibtex.open_file (filename, strict)
+        file   = opener (filename, strict)
         result = open (filename + '-ok', 'r')
 
         line     = 1
@@ -151,6 +152,39 @@ def check_bibtex ():
                 t, o, r)
             failures += 1
 
+    # letters beyond latin-1 are written in LaTeX as well
+    name  = u'\u0141ukasz Dvo\u0159\u00e1k'.encode ('utf-8')
+    field = _bibtex.reverse (0, True, name)
+    o     = _bibtex.get_latex (parser, field, 0)
+    checks += 1
+    if (o != r"{\L}ukasz Dvo\v{r}\'ak" or
+        _bibtex.expand (parser, field, 0) [2] != name):
+        print "beyond latin-1: got %r" % (o,)
+        failures += 1
+
+    # every latin-1 letter or symbol, and the ASCII characters with a
+    # meaning in LaTeX, read back as themselves once written; accented
+    # letters are written as recode wrote them
+    pinned = {'\xc3\xa9': r"\'e", '\xc3\x87': r'\c{C}', '\xc3\xad': r"\'{\i}",
+              '\xc3\xb1': r'\~n', '\xc3\xbc': r'\"u', '#': r'\#',
+              '\\': r'{\textbackslash}'}
+    for c in [unichr (i).encode ('utf-8') for i in range (161, 256)] + list ('{}#$%&_\\'):
+        o = convert (c, 0)
+        checks += 1
+        if (pinned.get (c, o) != o or
+            _bibtex.expand (parser, _bibtex.reverse (0, True, c), 0) [2] != c):
+            print "latin-1: %r written as %r" % (c, o)
+            failures += 1
+
+    # many values at once give the same fields as one at a time
+    values = ['%s %d, Foo and {Bar}' % (text, i) for i in range (1000)]
+    fields = _bibtex.reverse_all (2, True, values, 4)
+    for i in range (len (values)):
+        checks += 1
+        if _bibtex.get_latex (parser, fields [i], 2) != convert (values [i], 2):
+            print "reverse_all: value %d differs" % i
+            failures += 1
+
     for file in('tests/preamble.bib',
                 'tests/string.bib',
                 'tests/simple-2.bib'):
@@ -172,6 +206,578 @@ def check_bibtex ():
         failures = failures + f
         checks   = checks   + c
 
+    # rewinding a memory mapped source restarts from its first entry
+    file  = _bibtex.open_mmap ('tests/simple.bib', 1)
+    first = _bibtex.next (file)
+    _bibtex.next (file)
+    _bibtex.first (file)
+
+    checks = checks + 1
+    if _bibtex.next (file) != first:
+        sys.stderr.write ('error: tests/simple.bib: mapped source not rewound\n')
+        failures = failures + 1
+
+    # outside of texts, names and numbers stop at the characters that
+    # separate them; inside, words go on up to a brace or a space
+    file  = _bibtex.open_string ('tokens',
+                                 '@string{abc = "A"}\n'
+                                 '@misc{k, a = 1999, b = abc # {x@y=z%w 1,2},'
+                                 ' c = "p#q"}\n', 1)
+    items = _bibtex.next (file) [4]
+    texts = [_bibtex.expand (file, items [k], -1) [2] for k in 'abc']
+
+    checks = checks + 1
+    if texts != ['1999', 'Ax@y=z%w 1,2', 'p#q']:
+        sys.stderr.write ('error: tokens: got %r\n' % (texts,))
+        failures = failures + 1
+
+    # a lazy value that can't be parsed reports where it comes from,
+    # every time it is needed
+    file  = _bibtex.open_string ('lazy.bib', '@misc{k,\n  note = {fine},\n'
+                                 '  year = 12abc}\n', 1)
+    _bibtex.set_lazy (file, 1)
+    items  = _bibtex.next (file) [4]
+    errors = []
+    for parse in (lambda: _bibtex.expand (file, items ['year'], -1),
+                  lambda: _bibtex.expand (file, items ['year'], -1),
+                  lambda: _bibtex.get_native (items ['year'])):
+        try:
+            parse ()
+        except IOError:
+            errors.append (str (sys.exc_info () [1]) [:11])
+
+    checks = checks + 1
+    if (errors != ['lazy.bib:3:'] * 3 or
+        _bibtex.expand (file, items ['note'], -1) [2] != 'fine'):
+        sys.stderr.write ('error: faulty lazy value: %r\n' % (errors,))
+        failures = failures + 1
+
+    # empty groups inside a text are kept as such
+    file  = _bibtex.open_string ('empty', '@misc{k, title = {\\LaTeX{} rocks},'
+                                 ' note = {a {} b}}\n', 1)
+    items = _bibtex.next (file) [4]
+    texts = [(_bibtex.get_native (items [k]),
+              _bibtex.expand (file, items [k], -1) [2]) for k in ('title',
+                                                                   'note')]
+
+    checks = checks + 1
+    if (texts [0][0] != '{\\LaTeX{} rocks}' or
+        texts [1][0] != '{a {} b}' or texts [1][1].split () != ['a', 'b']):
+        sys.stderr.write ('error: empty groups: got %r\n' % (texts,))
+        failures = failures + 1
+
+    # entries with more fields than fit in the entry itself
+    text = '@misc{many,\n%s}\n' % ''.join (
+        ['  Field%d = {value %d},\n' % (i, i) for i in range (40)])
+
+    file  = _bibtex.open_string ('many', text, 1)
+    items = _bibtex.next (file) [4]
+
+    checks = checks + 1
+    if (sorted (items) != sorted (['field%d' % i for i in range (40)]) or
+        _bibtex.expand (file, items ['field5'], -1) [2] != 'value 5' or
+        _bibtex.expand (file, items ['field39'], -1) [2] != 'value 39'):
+        sys.stderr.write ('error: entry with many fields: %r\n' % (
+            sorted (items),))
+        failures = failures + 1
+
+    # unmodified entries are written back as they were read
+    import tempfile
+
+    original = open ('tests/simple.bib', 'rb').read ()
+    file     = _bibtex.open_mmap ('tests/simple.bib', 1)
+    entries  = []
+    while 1:
+        entry = _bibtex.next (file)
+        if entry is None: break
+        entries.append (entry)
+
+    offsets = [e [2] for e in entries]
+    items   = [(offsets [i], offsets [i + 1] - offsets [i])
+               for i in range (len (offsets) - 1)]
+    items.append ((offsets [-1], -1))
+
+    out = tempfile.TemporaryFile ()
+    _bibtex.write (file, out, items)
+    out.seek (0)
+
+    checks = checks + 1
+    if out.read () != original:
+        sys.stderr.write ('error: tests/simple.bib: not written back as is\n')
+        failures = failures + 1
+
+    # and the modified ones are written from their fields
+    key, type, offset, line, fields = entries [0]
+    items [0] = (type, key, sorted (fields.items ()))
+
+    out = tempfile.TemporaryFile ()
+    _bibtex.write (file, out, items)
+    out.seek (0)
+
+    copy   = _bibtex.open_string ('copy', out.read ().decode ('latin-1'), 1)
+    result = _bibtex.next (copy)
+
+    checks = checks + 1
+    if (result [:2] != entries [0][:2] or
+        sorted (result [4]) != sorted (fields) or
+        [_bibtex.expand (copy, result [4][k], -1) for k in sorted (fields)] !=
+        [_bibtex.expand (file, fields [k], -1) for k in sorted (fields)]):
+        sys.stderr.write ('error: tests/simple.bib: modified entry is %r\n' % (
+            result,))
+        failures = failures + 1
+
+    # items may use the source while it is written
+    first = sorted (fields) [0]
+
+    class Comment:
+        def __str__ (self):
+            return '%% %s\n' % _bibtex.expand (file, fields [first], -1) [2]
+
+    out = tempfile.TemporaryFile ()
+    _bibtex.write (file, out, [Comment ()] + items)
+    out.seek (0)
+
+    checks = checks + 1
+    if not out.read ().startswith ('% '):
+        sys.stderr.write ('error: item using its source not written\n')
+        failures = failures + 1
+
+    # entries are patched in place, and the parsing goes on after them
+    name = tempfile.mktemp ('.bib')
+    for opener in (_bibtex.open_file, _bibtex.open_mmap):
+        f = open (name, 'w')
+        f.write ('@misc{a, note = {one}}\n\n@misc{b, note = {two}}\n'
+                 '\n@misc{c, note = {three}}\n')
+        f.close ()
+
+        file  = opener (name, 1)
+        first = _bibtex.next (file)
+        after = _bibtex.next (file) [2]
+
+        shift = _bibtex.patch (file, 0, after, '@misc{a, note = {1}}')
+        shift = shift + _bibtex.patch (file, 0, after,
+                                       '@misc{a, note = {a longer one}}')
+        third = _bibtex.next (file)
+        text  = open (name).read ()
+
+        checks = checks + 1
+        if (shift != 9 or third [0] != 'c' or third [3] != 5 or
+            not text.startswith ('@misc{a, note = {a longer one}}\n\n@misc{b') or
+            text [third [2]:].strip () != '@misc{c, note = {three}}'):
+            sys.stderr.write ('error: patched file is %r, then %r\n' % (
+                text, third))
+            failures = failures + 1
+
+    # lazy fields read before the patches keep their text, even when a
+    # later patch rewrites them in the file
+    value = 'y' * 20000
+    f = open (name, 'w')
+    f.write ('@misc{a, note = {%s}}\n\n@misc{c, note = {three}}\n' % value)
+    f.close ()
+
+    file  = _bibtex.open_mmap (name, 1)
+    _bibtex.set_lazy (file, 1)
+    first = _bibtex.next (file)
+    after = _bibtex.next (file) [2]
+
+    _bibtex.patch (file, after, len (open (name).read ()) - after,
+                   '\n\n@misc{c, note = {a longer three}}\n')
+    _bibtex.patch (file, 0, after, '@misc{a, note = {%s}}' % ('z' * 20000))
+
+    checks = checks + 1
+    if (_bibtex.expand (file, first [4]['note'], -1) [2] != value or
+        not open (name).read ().startswith ('@misc{a, note = {zzz')):
+        sys.stderr.write ('error: lazy field changed by a second patch\n')
+        failures = failures + 1
+
+    # lazy fields after a patched entry follow their text as it moves
+    f = open (name, 'w')
+    f.write ('@misc{a, note = {one}}\n\n@misc{b, note = {two}}\n')
+    f.close ()
+
+    file   = _bibtex.open_mmap (name, 1)
+    _bibtex.set_lazy (file, 1)
+    first  = _bibtex.next (file)
+    second = _bibtex.next (file)
+
+    _bibtex.patch (file, 0, second [2], '@misc{a, note = {a longer one}}')
+
+    notes = [_bibtex.expand (file, entry [4]['note'], -1) [2]
+             for entry in (first, second)]
+
+    checks = checks + 1
+    if notes != ['one', 'two']:
+        sys.stderr.write ('error: lazy fields are %r after a patch\n' % (
+            notes,))
+        failures = failures + 1
+
+    os.unlink (name)
+
+    # lists of lists are flattened, and copied as a whole
+    file  = _bibtex.open_string ('lists', '@string{j = "J"}\n'
+                                 '@misc{lists, note = j # {a {b \\\'e} c}'
+                                 ' # "d" # j}\n', 1)
+    field = _bibtex.next (file) [4]['note']
+    copy  = _bibtex.copy_field (field)
+
+    checks = checks + 1
+    if (_bibtex.get_native (copy) != _bibtex.get_native (field) or
+        _bibtex.expand (file, copy, -1) != _bibtex.expand (file, field, -1)):
+        sys.stderr.write ('error: copied list differs: %s\n' % (
+            _bibtex.get_native (copy),))
+        failures = failures + 1
+
+    # expansions of @string macros follow their redefinitions
+    file  = _bibtex.open_string ('macros', '@string{j = "J"}\n'
+                                 '@misc{a, note = j # " x"}\n'
+                                 '@misc{b, note = j # " x"}\n'
+                                 '@misc{c, note = {K}}\n', 1)
+    a = _bibtex.next (file) [4]['note']
+    b = _bibtex.next (file) [4]['note']
+    c = _bibtex.next (file) [4]['note']
+
+    before = _bibtex.expand (file, a, -1) [2]
+    _bibtex.set_string (file, 'j', c)
+    after  = _bibtex.expand (file, b, -1) [2]
+
+    checks = checks + 1
+    if before != 'J x' or after != 'K x':
+        sys.stderr.write ('error: macro expansions: %r, %r\n' % (
+            before, after))
+        failures = failures + 1
+
+    # fields already expanded follow them too, through nested macros
+    file  = _bibtex.open_string ('macros', '@string{j = "J"}\n'
+                                 '@string{k = j # "y"}\n'
+                                 '@misc{a, note = k # " x"}\n'
+                                 '@misc{b, note = {z}}\n'
+                                 '@misc{c, note = {K}}\n', 1)
+    a = _bibtex.next (file) [4]['note']
+    b = _bibtex.next (file) [4]['note']
+    c = _bibtex.next (file) [4]['note']
+
+    before = (_bibtex.expand (file, a, -1) [2], 
+              _bibtex.expand (file, b, -1) [2])
+    _bibtex.set_string (file, 'j', c)
+    after  = (_bibtex.expand (file, a, -1) [2], 
+              _bibtex.expand (file, b, -1) [2])
+
+    checks = checks + 1
+    if before != ('Jy x', 'z') or after != ('Ky x', 'z'):
+        sys.stderr.write ('error: expanded fields: %r, %r\n' % (
+            before, after))
+        failures = failures + 1
+
+    # macros are found whatever the case of their name
+    file  = _bibtex.open_string ('case', '@string{Jour = "J"}\n'
+                                 '@misc{a, note = JOUR # jour}\n', 1)
+    field = _bibtex.next (file) [4]['note']
+
+    checks = checks + 1
+    if _bibtex.expand (file, field, -1) [2] != 'JJ':
+        sys.stderr.write ('error: macro case: %r\n' % (
+            _bibtex.expand (file, field, -1),))
+        failures = failures + 1
+
+    # accents outside of latin-1, straight into unicode; a dotless i
+    # alone is still written as a plain i
+    file  = _bibtex.open_string ('accents', '@misc{a, note = '
+                                 '{\\v{c}\\l\\H{o}\\k{a} \\\'{\\i} \\d{x} \\i}}\n', 1)
+    field = _bibtex.next (file) [4]['note']
+
+    checks = checks + 1
+    if _bibtex.expand (file, field, -1) [2] != u'\u010d\u0142\u0151\u0105 \u00ed x\u0323 i':
+        sys.stderr.write ('error: accents: %r\n' % (
+            _bibtex.expand (file, field, -1),))
+        failures = failures + 1
+
+    # author lists of several thousands of names
+    names = ' and '.join (['Name%d, First%d' % (i, i) for i in range (3000)])
+    file  = _bibtex.open_string ('authors', '@misc{a, author = {%s}}\n' %
+                                 names, 1)
+    field = _bibtex.next (file) [4]['author']
+    group = _bibtex.expand (file, field, 1) [3]
+
+    checks = checks + 1
+    if (len (group) != 3000 or
+        group [1234] != (None, 'First1234', 'Name1234', None)):
+        sys.stderr.write ('error: long author list: %d authors\n' % (
+            len (group),))
+        failures = failures + 1
+
+    # only the first ones are built, and the others counted
+    total, first = _bibtex.get_authors (file, field, 3)
+
+    checks = checks + 1
+    if (total != 3000 or 
+        first != [(None, 'First%d' % i, 'Name%d' % i, None)
+                  for i in range (3)]):
+        sys.stderr.write ('error: first authors: %r, %r\n' % (
+            total, first))
+        failures = failures + 1
+
+    # fields of several megabytes, in braces and in quotes
+    words = ' '.join (['w%d' % i for i in range (300000)])
+    
+    for value in ('{%s}', '"%s"'):
+        file  = _bibtex.open_string ('long', '@misc{long, abstract = %s}\n' %
+                                     (value % words), 1)
+        entry = _bibtex.next (file)
+
+        checks = checks + 1
+        if (entry is None or
+            _bibtex.expand (file, entry [4]['abstract'], -1) [2] != words):
+            sys.stderr.write ('error: long field %s not parsed\n' % (
+                value [0],))
+            failures = failures + 1
+
+    # parsing a large text at once on several threads gives the same
+    # entries as parsing it entry after entry
+    parts  = []
+    length = 0
+    
+    for i in range (4000):
+        entry = ('@article{key%d,\n  title = {Title %d},\n'
+                 '  journal = journal # " x"\n}\n\ncomment %d\n' % (i, i, i))
+
+        if i % 1000 == 0:
+            entry = '@string{ journal = "J%d" }\n\n' % i + entry
+
+        if length > 255000 and length < 265000:
+            # lines starting with @ inside a field, where the text is
+            # going to be cut
+            entry = ('@misc{tricky,\n  note = {' +
+                     '@not an entry\n' * 1000 + '}\n}\n') + entry
+
+        parts.append (entry)
+        length = length + len (entry)
+
+    text = ''.join (parts)
+
+    def summary (file, entry):
+        bibkey, bibtype, a, b, items = entry
+        return (bibkey, bibtype, a, b,
+                [(k, _bibtex.expand (file, items [k], -1))
+                 for k in sorted (items)])
+
+    file = _bibtex.open_string ('large', text, 1)
+    expected = []
+    while 1:
+        entry = _bibtex.next (file)
+        if entry is None: break
+        expected.append (summary (file, entry))
+
+    file = _bibtex.open_string ('large', text, 1)
+    obtained = [summary (file, entry)
+                for entry in _bibtex.parse_all (file, 4)]
+
+    checks = checks + 1
+    if obtained != expected or len (obtained) != 4001:
+        sys.stderr.write ('error: parse_all: %d entries differ\n' % (
+            len ([o for o, e in zip (obtained, expected) if o != e]) +
+            abs (len (obtained) - len (expected))))
+        failures = failures + 1
+
+    # the same, by batches of entries or by iterating over the source
+    def batches (file):
+        entries = []
+        while 1:
+            batch = _bibtex.next_many (file, 300)
+            if not batch: break
+            entries.extend (batch)
+        return entries
+
+    for parse in (batches, list):
+        file = _bibtex.open_string ('large', text, 1)
+        obtained = [summary (file, entry) for entry in parse (file)]
+
+        checks = checks + 1
+        if obtained != expected:
+            sys.stderr.write ('error: entries by batches differ\n')
+            failures = failures + 1
+
+    # the same, when loading a whole file at once
+    name = tempfile.mktemp ('.bib')
+    f = open (name, 'w')
+    f.write (text)
+    f.close ()
+
+    obtained = [entry [:4] for entry in _bibtex.load_all (name, 1)]
+    os.unlink (name)
+
+    checks = checks + 1
+    if obtained != [entry [:4] for entry in expected]:
+        sys.stderr.write ('error: load_all: entries differ\n')
+        failures = failures + 1
+
+    # the same, with fields only parsed when needed
+    for parse in (lambda file: _bibtex.parse_all (file, 4),
+                  lambda file: iter (lambda: _bibtex.next (file), None)):
+        file = _bibtex.open_string ('large', text, 1)
+        _bibtex.set_lazy (file, 1)
+        obtained = [summary (file, entry) for entry in parse (file)]
+
+        checks = checks + 1
+        if obtained != expected:
+            sys.stderr.write ('error: lazy fields differ\n')
+            failures = failures + 1
+
+    # the same, with the entries allocated in a region of the source
+    file = _bibtex.open_string ('large', text, 1)
+    _bibtex.use_region (file)
+    entries  = _bibtex.parse_all (file, 4)
+    obtained = [summary (file, entry) for entry in entries]
+
+    checks = checks + 1
+    if obtained != expected:
+        sys.stderr.write ('error: parse_all: region entries differ\n')
+        failures = failures + 1
+
+    # their fields remain valid once the source is gone
+    field    = entries [0][4]['title']
+    expected = _bibtex.get_native (field)
+    del file, entries
+
+    checks = checks + 1
+    if _bibtex.get_native (field) != expected:
+        sys.stderr.write ('error: region field does not outlive its source\n')
+        failures = failures + 1
+
+    # the entries before an error are returned, and the error is raised
+    # by the next call, which goes on after the faulty entry
+    text = ('@misc{a, note = {1}}\n\n@misc{b, note = {2} junk}\n\n'
+            '@misc{c, note = {3}}\n')
+    file  = _bibtex.open_string ('error', text, 1)
+    first = [entry [0] for entry in _bibtex.parse_all (file, 4)]
+    try:
+        _bibtex.parse_all (file, 4)
+        raised = 0
+    except IOError:
+        raised = 1
+    rest  = [entry [0] for entry in _bibtex.parse_all (file, 4)]
+
+    checks = checks + 1
+    if first != ['a'] or not raised or rest != ['c']:
+        sys.stderr.write ('error: parse_all: got %r, %r, %r around an error\n'
+                          % (first, raised, rest))
+        failures = failures + 1
+
+    # the same, by batches
+    file  = _bibtex.open_string ('error', text, 1)
+    first = [entry [0] for entry in _bibtex.next_many (file, 10)]
+    try:
+        _bibtex.next_many (file, 10)
+        raised = 0
+    except IOError:
+        raised = 1
+    rest  = [entry [0] for entry in _bibtex.next_many (file, 10)]
+
+    checks = checks + 1
+    if first != ['a'] or not raised or rest != ['c']:
+        sys.stderr.write ('error: next_many: got %r, %r, %r around an error\n'
+                          % (first, raised, rest))
+        failures = failures + 1
+
+    # when loading a whole file, the faulty entry is only a warning
+    import warnings
+
+    name = tempfile.mktemp ('.bib')
+    f = open (name, 'w')
+    f.write (text)
+    f.close ()
+
+    with warnings.catch_warnings (record = True) as caught:
+        warnings.simplefilter ('always', RuntimeWarning)
+        obtained = [entry [0] for entry in _bibtex.load_all (name, 1)]
+    os.unlink (name)
+
+    checks = checks + 1
+    if obtained != ['a', 'c'] or len (caught) != 1:
+        sys.stderr.write ('error: load_all: got %r and %d warnings\n'
+                          % (obtained, len (caught)))
+        failures = failures + 1
+
+    # parse the whole corpus again, from several threads at once
+    import threading
+
+    results = []
+    
+    def check_corpus (opener):
+        f, c = 0, 0
+
+        for file in('tests/preamble.bib',
+                    'tests/string.bib',
+                    'tests/simple-2.bib'):
+            r = checkunfiltered (file, opener = opener)
+            f, c = f + r [0], c + r [1]
+
+        for file in ('tests/simple.bib',
+                     'tests/authors.bib',
+                     'tests/eof.bib',
+                     'tests/paren.bib',
+                     'tests/url.bib'):
+            r = checkfile (file, typemap = {'url': 4}, opener = opener)
+            f, c = f + r [0], c + r [1]
+
+        results.append ((f, c))
+
+    def open_region (filename, strict):
+        file = _bibtex.open_mmap (filename, strict)
+        _bibtex.use_region (file)
+        return file
+
+    def open_lazy (filename, strict):
+        file = _bibtex.open_mmap (filename, strict)
+        _bibtex.set_lazy (file, 1)
+        return file
+
+    # the threads read their files in turn through stdio, a memory
+    # mapping, a memory mapping with a region, and lazily
+    threads = [threading.Thread (target = check_corpus, args = (opener,))
+               for opener in (_bibtex.open_file, _bibtex.open_mmap,
+                              open_region, open_lazy) * 2]
+
+    for thread in threads: thread.start ()
+    for thread in threads: thread.join ()
+
+    for f, c in results:
+        failures = failures + f
+        checks   = checks   + c
+
+    if len (results) != len (threads):
+        sys.stderr.write ('error: %d threads did not complete\n' % (
+            len (threads) - len (results)))
+        failures = failures + 1
+
+    # reverse and parse isolated values, from several threads at once
+    def check_values ():
+        f, c = 0, 0
+
+        for i in range (200):
+            field = _bibtex.set_native ('{v %d} # " w"' % i, 0)
+            c = c + 2
+            if _bibtex.expand (parser, field, -1) [2] != 'v %d w' % i:
+                f = f + 1
+            if convert ('value %d' % i, 0) != 'value %d' % i:
+                f = f + 1
+
+        results.append ((f, c))
+
+    results = []
+    threads = [threading.Thread (target = check_values) for i in range (8)]
+
+    for thread in threads: thread.start ()
+    for thread in threads: thread.join ()
+
+    for f, c in results:
+        failures = failures + f
+        checks   = checks   + c
+
+    if len (results) != len (threads):
+        sys.stderr.write ('error: %d threads did not complete\n' % (
+            len (threads) - len (results)))
+        failures = failures + 1
+
     print "testsuite: %d checks, %d failures" % (checks, failures)
     return failures
 
@@ -0,0 +1,413 @@
+/*
+ This file is part of pybliographer
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either version 2
+ of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+/* for copy_file_range */
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "bibtex.h"
+
+/* size of the pieces copied by hand */
+#define COPY_BUFFER_SIZE (256 * 1024)
+
+
+gboolean
+bibtex_write_text (int fd,
+		   const gchar * text,
+		   gsize length) {
+    gssize done;
+
+    g_return_val_if_fail (text != NULL, FALSE);
+
+    while (length > 0) {
+	done = write (fd, text, length);
+
+	if (done == -1) {
+	    if (errno == EINTR) continue;
+
+	    bibtex_error ("can't write: %s", g_strerror (errno));
+	    return FALSE;
+	}
+
+	text   += done;
+	length -= done;
+    }
+
+    return TRUE;
+}
+
+/* Copy length bytes of the file from offset, by hand */
+static gboolean
+copy_by_hand (int in,
+	      off_t offset,
+	      gsize length,
+	      int out,
+	      const gchar * name) {
+    gchar * buffer;
+    gssize done;
+    gboolean ok = TRUE;
+
+    buffer = g_malloc (MIN (length, COPY_BUFFER_SIZE));
+
+    while (ok && length > 0) {
+	done = pread (in, buffer, MIN (length, COPY_BUFFER_SIZE), offset);
+
+	if (done == -1 && errno == EINTR) continue;
+
+	if (done <= 0) {
+	    bibtex_error ("%s: can't read: %s", name,
+			  done ? g_strerror (errno) : "file is too short");
+	    ok = FALSE;
+	    break;
+	}
+
+	ok = bibtex_write_text (out, buffer, done);
+
+	offset += done;
+	length -= done;
+    }
+
+    g_free (buffer);
+
+    return ok;
+}
+
+/*
+   Copy part of a file. The kernel does it on its own if it can,
+   otherwise we read and write it by hand.
+*/
+static gboolean
+copy_file (const gchar * name,
+	   off_t offset,
+	   gsize length,
+	   int out) {
+    int in;
+    gboolean ok = TRUE;
+
+#ifdef __linux__
+    gssize done;
+    loff_t from;
+#endif
+
+    in = open (name, O_RDONLY);
+
+    if (in == -1) {
+	bibtex_error ("can't open file `%s': %s", name, g_strerror (errno));
+	return FALSE;
+    }
+
+#ifdef __linux__
+    from = offset;
+
+    while (length > 0) {
+	done = copy_file_range (in, & from, out, NULL, length, 0);
+
+	if (done == -1 && errno == EINTR) continue;
+	if (done <= 0) break;
+
+	length -= done;
+    }
+
+    offset = from;
+#endif
+
+    if (length > 0) {
+	ok = copy_by_hand (in, offset, length, out, name);
+    }
+
+    close (in);
+
+    return ok;
+}
+
+gboolean
+bibtex_source_copy (BibtexSource * source,
+		    gint offset,
+		    gint length,
+		    int fd) {
+    struct stat info;
+    gsize size;
+
+    g_return_val_if_fail (source != NULL, FALSE);
+
+    switch (source->type) {
+    case BIBTEX_SOURCE_STRING:
+	size = source->source.string.length;
+	break;
+
+    case BIBTEX_SOURCE_MMAP:
+	size = source->source.map.length;
+	break;
+
+    case BIBTEX_SOURCE_FILE:
+	if (stat (source->name, & info) == -1) {
+	    bibtex_error ("can't stat file `%s': %s", source->name,
+			  g_strerror (errno));
+	    return FALSE;
+	}
+	size = info.st_size;
+	break;
+
+    default:
+	g_warning ("no source to copy");
+	return FALSE;
+    }
+
+    /* a negative length goes up to the end */
+    if (length < 0 && offset >= 0 && (gsize) offset <= size) {
+	length = size - offset;
+    }
+
+    if (offset < 0 || length < 0 || (gsize) offset + length > size) {
+	bibtex_error ("%s: can't copy %d bytes at offset %d: out of range",
+		      source->name, length, offset);
+	return FALSE;
+    }
+
+    if (length == 0) return TRUE;
+
+    if (source->type == BIBTEX_SOURCE_STRING) {
+	return bibtex_write_text (fd, source->source.string.text + offset, length);
+    }
+
+    /*
+       The scanner writes in its buffer while reading a mapped file:
+       the file itself is copied instead.
+    */
+    return copy_file (source->name, offset, length, fd);
+}
+
+void
+bibtex_field_write (BibtexField * field,
+		    GString * out) {
+    BibtexSource * source;
+
+    g_return_if_fail (field != NULL);
+    g_return_if_fail (out != NULL);
+
+    /* a value that was never parsed is still as in the file */
+    if (field->structure == NULL && field->raw) {
+	source = field->raw_source;
+
+	if (source) g_mutex_lock (& source->raw_lock);
+	g_string_append_len (out, field->raw, field->raw_length);
+	if (source) g_mutex_unlock (& source->raw_lock);
+
+	return;
+    }
+
+    if (bibtex_field_get_structure (field)) {
+	bibtex_struct_write_bibtex (field->structure, out);
+    }
+}
+
+/* Count the lines in length bytes of a file at offset */
+static gboolean
+count_lines (int fd,
+	     off_t offset,
+	     gsize length,
+	     gint * lines) {
+    gchar * buffer;
+    gssize done;
+    gsize i;
+
+    buffer = g_malloc (MIN (length, COPY_BUFFER_SIZE) + 1);
+
+    while (length > 0) {
+	done = pread (fd, buffer, MIN (length, COPY_BUFFER_SIZE), offset);
+
+	if (done == -1 && errno == EINTR) continue;
+	if (done <= 0) break;
+
+	for (i = 0; i < (gsize) done; i ++) {
+	    if (buffer [i] == '\n') (* lines) ++;
+	}
+
+	offset += done;
+	length -= done;
+    }
+
+    g_free (buffer);
+
+    return (length == 0);
+}
+
+/* 
+   Move the end of the file, from offset, further by shift bytes.
+   It is copied backward, so that nothing is overwritten before being
+   moved.
+*/
+static gboolean
+move_tail (int fd,
+	   off_t offset,
+	   off_t end,
+	   gint shift) {
+    gchar * buffer;
+    gssize done;
+    gsize size;
+    gboolean ok = TRUE;
+
+    buffer = g_malloc (COPY_BUFFER_SIZE);
+
+    while (ok && end > offset) {
+	size = MIN (end - offset, COPY_BUFFER_SIZE);
+
+	done = pread (fd, buffer, size, end - size);
+
+	if (done == -1 && errno == EINTR) continue;
+
+	ok = (done == (gssize) size &&
+	      pwrite (fd, buffer, size, end - size + shift) == (gssize) size);
+
+	end -= size;
+    }
+
+    g_free (buffer);
+
+    return ok;
+}
+
+gboolean
+bibtex_source_patch (BibtexSource * source,
+		     gint offset,
+		     gint length,
+		     const gchar * text,
+		     gsize size,
+		     gint * shift) {
+    struct stat info;
+    gboolean ok, mapped;
+    gint lines = 0, old_lines = 0, moved = 0;
+    GQueue * messages = NULL;
+    gchar * padding;
+    gsize i;
+    int fd;
+
+    g_return_val_if_fail (source != NULL, FALSE);
+    g_return_val_if_fail (text != NULL, FALSE);
+
+    if (source->type != BIBTEX_SOURCE_FILE &&
+	source->type != BIBTEX_SOURCE_MMAP) {
+	bibtex_error ("%s: not a file, can't be patched", source->name);
+	return FALSE;
+    }
+
+    fd = open (source->name, O_RDWR);
+
+    if (fd == -1 || fstat (fd, & info) == -1) {
+	bibtex_error ("can't open file `%s': %s", source->name,
+		      g_strerror (errno));
+	if (fd != -1) close (fd);
+	return FALSE;
+    }
+
+    if (offset < 0 || length < 0 || offset + length > info.st_size) {
+	bibtex_error ("%s: can't patch %d bytes at offset %d: out of range",
+		      source->name, length, offset);
+	close (fd);
+	return FALSE;
+    }
+
+    /* the lines of the new text, less those of the old one */
+    for (i = 0; i < size; i ++) {
+	if (text [i] == '\n') lines ++;
+    }
+
+    ok     = count_lines (fd, offset, length, & old_lines);
+    lines -= old_lines;
+
+    /* 
+       No lazy field of a mapped file is read until it follows the
+       change, and the text it loses is copied first. The messages
+       wait for the lock to be released: emitting them might wait for
+       a thread waiting on it.
+    */
+    mapped = (source->type == BIBTEX_SOURCE_MMAP);
+
+    if (mapped) {
+	messages = g_queue_new ();
+	bibtex_messages_defer (messages);
+
+	g_mutex_lock (& source->raw_lock);
+	bibtex_source_copy_raw (source, offset, length);
+    }
+
+    if (ok && size > (gsize) length) {
+	/* the text does not fit: the rest of the file moves along */
+	moved = size - length;
+	ok = move_tail (fd, offset + length, info.st_size, moved);
+    }
+
+    if (ok) {
+	ok = (pwrite (fd, text, size, offset) == (gssize) size);
+    }
+
+    /* a shorter text leaves spaces, which are outside of any entry */
+    if (ok && size < (gsize) length) {
+	padding = g_strnfill (length - size, ' ');
+	ok = (pwrite (fd, padding, length - size, offset + size) == 
+	      (gssize) (length - size));
+	g_free (padding);
+    }
+
+    if (! ok) {
+	bibtex_error ("%s: can't patch: %s", source->name,
+		      g_strerror (errno));
+    }
+
+    close (fd);
+
+    if (ok) {
+	/* the entries already parsed after the patch are not parsed again */
+	if (source->offset >= offset + length) {
+	    source->offset += moved;
+	    source->line   += lines;
+	}
+
+	if (mapped) {
+	    ok = bibtex_source_remap (source, offset, length, moved);
+	}
+    }
+
+    if (mapped) {
+	g_mutex_unlock (& source->raw_lock);
+
+	bibtex_messages_defer (NULL);
+	bibtex_messages_flush (messages, TRUE);
+	g_queue_free (messages);
+    }
+
+    if (! ok) return FALSE;
+
+    /* the scanner might have read ahead what changed */
+    if (! source->eof) {
+	bibtex_source_set_offset (source, source->offset);
+    }
+
+    if (shift) * shift = moved;
+
+    return TRUE;
+}